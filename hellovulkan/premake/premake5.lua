@@ -10,9 +10,11 @@ workspace (_AMD_SAMPLE_NAME)
     startproject (_AMD_SAMPLE_NAME)
 
     filter "platforms:x64"
-        system "Windows"
         architecture "x64"
 
+    filter { "platforms:x64", "action:vs*" }
+        system "Windows"
+
 project (_AMD_SAMPLE_NAME)
     kind "WindowedApp"
     language "C++"
@@ -28,11 +30,21 @@ project (_AMD_SAMPLE_NAME)
     windowstarget (_AMD_WIN_SDK_VERSION)
 
     files { "../src/**.h", "../src/**.cpp" }
-    links { "$(VULKAN_SDK)/lib/vulkan-1.lib" }
     includedirs { "$(VULKAN_SDK)/include" }
 
     defines { "_CRT_SECURE_NO_WARNINGS" }
 
+    filter "system:windows"
+        links { "$(VULKAN_SDK)/lib/vulkan-1.lib" }
+
+    -- Only the headless mode is supported outside of Windows. The texture
+    -- loader uses WIC, so the textured sample is Windows-only as well
+    filter "system:linux"
+        kind "ConsoleApp"
+        cppdialect "C++14"
+        links { "vulkan", "pthread" }
+        removefiles { "../src/ImageIO.cpp", "../src/VulkanTexturedQuad.cpp" }
+
     filter "configurations:Debug"
         defines { "WIN32", "_DEBUG", "DEBUG", "_WINDOWS" }
         flags { "Symbols", "FatalWarnings", "Unicode", "WinMain" }
@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "CommandAllocator.h"
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+CommandAllocator::CommandAllocator(VkDevice device, const int queueFamilyIndex,
+    const VkAllocationCallbacks* allocationCallbacks)
+    : device_(device)
+    , allocationCallbacks_(allocationCallbacks)
+{
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+    // No RESET_COMMAND_BUFFER, buffers are only ever reset with the pool
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    vkCreateCommandPool(device_, &commandPoolCreateInfo, allocationCallbacks_,
+        &commandPool_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+CommandAllocator::~CommandAllocator()
+{
+    // Destroying the pool frees all command buffers allocated from it
+    vkDestroyCommandPool(device_, commandPool_, allocationCallbacks_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+VkCommandBuffer CommandAllocator::Allocate(const VkCommandBufferLevel level)
+{
+    auto& list = (level == VK_COMMAND_BUFFER_LEVEL_PRIMARY) ? primary_ : secondary_;
+
+    if (list.usedCount == list.commandBuffers.size())
+    {
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocateInfo.commandBufferCount = 1;
+        commandBufferAllocateInfo.commandPool = commandPool_;
+        commandBufferAllocateInfo.level = level;
+
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        vkAllocateCommandBuffers(device_, &commandBufferAllocateInfo,
+            &commandBuffer);
+        list.commandBuffers.push_back(commandBuffer);
+    }
+
+    return list.commandBuffers[list.usedCount++];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void CommandAllocator::Reset()
+{
+    vkResetCommandPool(device_, commandPool_, 0);
+
+    primary_.usedCount = 0;
+    secondary_.usedCount = 0;
+}
+}   // namespace AMD
@@ -0,0 +1,79 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_COMMANDALLOCATOR_H_
+#define AMD_VULKAN_SAMPLE_COMMANDALLOCATOR_H_
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Hands out command buffers from a single transient command pool. All
+* buffers are recycled at once by Reset(), which resets the whole pool
+* instead of individual command buffers. The buffers themselves stay
+* allocated, so after a few frames Allocate() only returns existing ones.
+*
+* Like the pool it wraps, an allocator must only be used by one thread at
+* a time.
+*/
+class CommandAllocator
+{
+public:
+    CommandAllocator(const CommandAllocator&) = delete;
+    CommandAllocator& operator= (const CommandAllocator&) = delete;
+
+    CommandAllocator(VkDevice device, const int queueFamilyIndex,
+        const VkAllocationCallbacks* allocationCallbacks = nullptr);
+    ~CommandAllocator();
+
+    /**
+    * Return a command buffer in the initial state. It remains valid until
+    * the next Reset().
+    */
+    VkCommandBuffer Allocate(const VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    /**
+    * Reset all command buffers handed out so far. The GPU must be done
+    * with all of them.
+    */
+    void Reset();
+
+private:
+    struct CommandBufferList
+    {
+        std::vector<VkCommandBuffer> commandBuffers;
+        std::size_t usedCount = 0;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    const VkAllocationCallbacks* allocationCallbacks_ = nullptr;
+    VkCommandPool commandPool_ = VK_NULL_HANDLE;
+
+    CommandBufferList primary_;
+    CommandBufferList secondary_;
+};
+}   // namespace AMD
+
+#endif
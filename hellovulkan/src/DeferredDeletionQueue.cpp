@@ -0,0 +1,120 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "DeferredDeletionQueue.h"
+
+#include "FrameScheduler.h"
+
+#include <cassert>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+DeferredDeletionQueue::DeferredDeletionQueue(VkDevice device,
+    DeviceMemoryAllocator& allocator, const FrameScheduler& frameScheduler,
+    const VkAllocationCallbacks* allocationCallbacks)
+    : device_(device)
+    , allocationCallbacks_(allocationCallbacks)
+    , allocator_(allocator)
+    , frameScheduler_(frameScheduler)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+DeferredDeletionQueue::~DeferredDeletionQueue()
+{
+    // Whoever owns the queue has to Flush() it while the device is idle
+    assert(entries_.empty());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeferredDeletionQueue::Enqueue(std::function<void()> deleter)
+{
+    Enqueue(frameScheduler_.GetCurrentFrame(), std::move(deleter));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeferredDeletionQueue::Enqueue(const uint64_t frame,
+    std::function<void()> deleter)
+{
+    Entry entry;
+    entry.frame = frame;
+    entry.deleter = std::move(deleter);
+
+    entries_.push_back(std::move(entry));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeferredDeletionQueue::Collect()
+{
+    if (entries_.empty())
+    {
+        return;
+    }
+
+    const uint64_t retiredFrame = frameScheduler_.GetRetiredFrame();
+
+    // Deleters may enqueue more entries, so don't iterate entries_ itself
+    std::vector<Entry> entries;
+    entries.swap(entries_);
+
+    // Entries with an explicit frame can be older than the ones before
+    // them, so check them all, keeping the order of the survivors
+    std::vector<Entry> pendingEntries;
+
+    for (auto& entry : entries)
+    {
+        if (entry.frame <= retiredFrame)
+        {
+            entry.deleter();
+        }
+        else
+        {
+            pendingEntries.push_back(std::move(entry));
+        }
+    }
+
+    for (auto& entry : entries_)
+    {
+        pendingEntries.push_back(std::move(entry));
+    }
+
+    entries_.swap(pendingEntries);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeferredDeletionQueue::Flush()
+{
+    // A deleter may enqueue more work, for instance an object which owns
+    // UniqueHandles, so keep going until nothing is left
+    while (!entries_.empty())
+    {
+        std::vector<Entry> entries;
+        entries.swap(entries_);
+
+        for (auto& entry : entries)
+        {
+            entry.deleter();
+        }
+    }
+}
+}   // namespace AMD
@@ -0,0 +1,122 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_DEFERREDDELETIONQUEUE_H_
+#define AMD_VULKAN_SAMPLE_DEFERREDDELETIONQUEUE_H_
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace AMD
+{
+class DeviceMemoryAllocator;
+class FrameScheduler;
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Destroys objects once the GPU is done with them, instead of waiting for
+* the device to go idle.
+*
+* Each entry is tagged with the frame which is being recorded when it is
+* enqueued - the last frame which may still use the object - and runs
+* once the frame scheduler reports that frame as retired. Replacing a
+* buffer or texture while frames are in flight is then just a matter of
+* resetting its UniqueHandle and creating the new one.
+*
+* Not thread-safe, use it from the thread which calls Run().
+*/
+class DeferredDeletionQueue
+{
+public:
+    DeferredDeletionQueue(const DeferredDeletionQueue&) = delete;
+    DeferredDeletionQueue& operator= (const DeferredDeletionQueue&) = delete;
+
+    DeferredDeletionQueue(VkDevice device, DeviceMemoryAllocator& allocator,
+        const FrameScheduler& frameScheduler,
+        const VkAllocationCallbacks* allocationCallbacks = nullptr);
+    ~DeferredDeletionQueue();
+
+    /**
+    * Run deleter once the current frame has retired.
+    */
+    void Enqueue(std::function<void()> deleter);
+
+    /**
+    * Run deleter once frame has retired. Use this if the object is known
+    * to be unused since an earlier frame.
+    */
+    void Enqueue(const uint64_t frame, std::function<void()> deleter);
+
+    /**
+    * Run the deleters of all retired frames. Call this once per frame.
+    */
+    void Collect();
+
+    /**
+    * Run all deleters. The device must be idle.
+    */
+    void Flush();
+
+    VkDevice GetDevice() const
+    {
+        return device_;
+    }
+
+    /**
+    * Callbacks the queued objects were created with.
+    */
+    const VkAllocationCallbacks* GetAllocationCallbacks() const
+    {
+        return allocationCallbacks_;
+    }
+
+    DeviceMemoryAllocator& GetAllocator() const
+    {
+        return allocator_;
+    }
+
+    int GetPendingCount() const
+    {
+        return static_cast<int> (entries_.size());
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t frame;
+        std::function<void()> deleter;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    const VkAllocationCallbacks* allocationCallbacks_ = nullptr;
+    DeviceMemoryAllocator& allocator_;
+    const FrameScheduler& frameScheduler_;
+
+    // In the order the entries were enqueued, which is also the order in
+    // which they are deleted
+    std::vector<Entry> entries_;
+};
+}   // namespace AMD
+
+#endif
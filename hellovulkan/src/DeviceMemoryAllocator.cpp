@@ -0,0 +1,767 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "DeviceMemoryAllocator.h"
+
+#include "Utility.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace AMD
+{
+namespace
+{
+// Smallest range handed out, everything below gets rounded up to this
+const VkDeviceSize MinAllocationSize = 256;
+
+///////////////////////////////////////////////////////////////////////////////
+int GetOrder(const VkDeviceSize size)
+{
+    int order = 0;
+
+    while ((MinAllocationSize << order) < size)
+    {
+        ++order;
+    }
+
+    return order;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+VkDeviceSize GetOrderSize(const int order)
+{
+    return MinAllocationSize << order;
+}
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+struct DeviceMemoryBlock
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    int memoryTypeIndex = -1;
+    DeviceMemoryResourceType resourceType = DMRT_Linear;
+    void* mapping = nullptr;
+    bool hostCoherent = false;
+
+    // Holds a single resource, no sub-allocation
+    bool dedicated = false;
+    // Being emptied by the defragmenter, don't allocate from it
+    bool evacuating = false;
+
+    int allocationCount = 0;
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize allocatedBytes = 0;
+
+    // Offsets of the free ranges, indexed by order. The block starts out as
+    // a single free range of the highest order.
+    std::vector<std::vector<VkDeviceSize>> freeLists;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+DeviceMemoryAllocator::DeviceMemoryAllocator(VkPhysicalDevice physicalDevice,
+    VkDevice device, const DeviceMemoryProperties& memoryProperties,
+    const VkAllocationCallbacks* allocationCallbacks,
+    const VkDeviceSize blockSize)
+    : device_(device)
+    , allocationCallbacks_(allocationCallbacks)
+    , memoryProperties_(memoryProperties)
+    , blockSize_(GetOrderSize(GetOrder(blockSize)))
+{
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+    nonCoherentAtomSize_ = std::max<VkDeviceSize>(1,
+        physicalDeviceProperties.limits.nonCoherentAtomSize);
+
+    // Buddy ranges never share a page if the smallest one is at least as
+    // large as the granularity
+    separateResourceTypes_ =
+        physicalDeviceProperties.limits.bufferImageGranularity > MinAllocationSize;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+DeviceMemoryAllocator::~DeviceMemoryAllocator()
+{
+    for (auto& block : blocks_)
+    {
+        if (block->mapping)
+        {
+            vkUnmapMemory(device_, block->memory);
+        }
+
+        vkFreeMemory(device_, block->memory, allocationCallbacks_);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool DeviceMemoryAllocator::Allocate(const VkMemoryRequirements& requirements,
+    const MemoryUsage usage,
+    const DeviceMemoryResourceType resourceType,
+    DeviceMemoryAllocation* outputAllocation)
+{
+    return Allocate(requirements, usage, resourceType, nullptr,
+        outputAllocation);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool DeviceMemoryAllocator::AllocateForImage(VkImage image,
+    const MemoryUsage usage, DeviceMemoryAllocation* outputAllocation)
+{
+    VkImageMemoryRequirementsInfo2 requirementsInfo = {};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.image = image;
+
+    VkMemoryDedicatedRequirements dedicatedRequirements = {};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+    VkMemoryRequirements2 requirements = {};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicatedRequirements;
+
+    vkGetImageMemoryRequirements2(device_, &requirementsInfo, &requirements);
+
+    VkMemoryDedicatedAllocateInfo dedicatedAllocateInfo = {};
+    dedicatedAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedAllocateInfo.image = image;
+
+    const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation ||
+        dedicatedRequirements.requiresDedicatedAllocation;
+
+    return Allocate(requirements.memoryRequirements, usage, DMRT_Optimal,
+        dedicated ? &dedicatedAllocateInfo : nullptr, outputAllocation);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool DeviceMemoryAllocator::AllocateForBuffer(VkBuffer buffer,
+    const MemoryUsage usage, DeviceMemoryAllocation* outputAllocation)
+{
+    VkBufferMemoryRequirementsInfo2 requirementsInfo = {};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.buffer = buffer;
+
+    VkMemoryDedicatedRequirements dedicatedRequirements = {};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+    VkMemoryRequirements2 requirements = {};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicatedRequirements;
+
+    vkGetBufferMemoryRequirements2(device_, &requirementsInfo, &requirements);
+
+    VkMemoryDedicatedAllocateInfo dedicatedAllocateInfo = {};
+    dedicatedAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedAllocateInfo.buffer = buffer;
+
+    const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation ||
+        dedicatedRequirements.requiresDedicatedAllocation;
+
+    return Allocate(requirements.memoryRequirements, usage, DMRT_Linear,
+        dedicated ? &dedicatedAllocateInfo : nullptr, outputAllocation);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool DeviceMemoryAllocator::Allocate(const VkMemoryRequirements& requirements,
+    const MemoryUsage usage,
+    const DeviceMemoryResourceType resourceType,
+    const VkMemoryDedicatedAllocateInfo* dedicatedAllocateInfo,
+    DeviceMemoryAllocation* outputAllocation)
+{
+    assert(outputAllocation);
+
+    uint32_t memoryTypeBits = requirements.memoryTypeBits;
+
+    for (;;)
+    {
+        const int memoryTypeIndex = memoryProperties_.FindMemoryType(
+            memoryTypeBits, usage, requirements.size);
+
+        if (memoryTypeIndex == -1)
+        {
+            return false;
+        }
+
+        const bool allocated = dedicatedAllocateInfo
+            ? AllocateDedicated(requirements, memoryTypeIndex, resourceType,
+                dedicatedAllocateInfo, outputAllocation)
+            : AllocateFromMemoryType(requirements, memoryTypeIndex, resourceType,
+                true, outputAllocation);
+
+        if (allocated)
+        {
+            return true;
+        }
+
+        memoryTypeBits &= ~(1u << memoryTypeIndex);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool DeviceMemoryAllocator::AllocateFromMemoryType(const VkMemoryRequirements& requirements,
+    const int memoryTypeIndex,
+    const DeviceMemoryResourceType resourceType,
+    const bool allowNewBlock,
+    DeviceMemoryAllocation* outputAllocation)
+{
+    // Buddy ranges are aligned to their size, so rounding the size up to
+    // the alignment takes care of both
+    const int order = GetOrder(std::max(requirements.size, requirements.alignment));
+
+    // Anything larger than a block gets a memory object of exactly its
+    // size, rounding it up to the next order could waste almost half
+    if (GetOrderSize(order) > blockSize_)
+    {
+        return allowNewBlock && AllocateDedicated(requirements, memoryTypeIndex,
+            resourceType, nullptr, outputAllocation);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    DeviceMemoryBlock* block = nullptr;
+    int freeOrder = -1;
+
+    for (auto& candidate : blocks_)
+    {
+        if (candidate->memoryTypeIndex != memoryTypeIndex)
+        {
+            continue;
+        }
+
+        if (separateResourceTypes_ && candidate->resourceType != resourceType)
+        {
+            continue;
+        }
+
+        if (candidate->evacuating)
+        {
+            continue;
+        }
+
+        const int orderCount = static_cast<int> (candidate->freeLists.size());
+
+        for (int i = order; i < orderCount; ++i)
+        {
+            if (!candidate->freeLists[i].empty())
+            {
+                block = candidate.get();
+                freeOrder = i;
+                break;
+            }
+        }
+
+        if (block)
+        {
+            break;
+        }
+    }
+
+    if (!block)
+    {
+        if (!allowNewBlock)
+        {
+            return false;
+        }
+
+        block = CreateBlock(memoryTypeIndex, resourceType, blockSize_, false);
+
+        if (!block)
+        {
+            return false;
+        }
+
+        freeOrder = static_cast<int> (block->freeLists.size()) - 1;
+    }
+
+    VkDeviceSize offset = block->freeLists[freeOrder].back();
+    block->freeLists[freeOrder].pop_back();
+
+    // Split until we reach the requested size, the upper halves become free
+    while (freeOrder > order)
+    {
+        --freeOrder;
+        block->freeLists[freeOrder].push_back(offset + GetOrderSize(freeOrder));
+    }
+
+    ++block->allocationCount;
+    block->usedBytes += requirements.size;
+    block->allocatedBytes += GetOrderSize(order);
+
+    DeviceMemoryAllocation allocation;
+    allocation.memory = block->memory;
+    allocation.offset = offset;
+    allocation.size = requirements.size;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.hostCoherent = block->hostCoherent;
+    allocation.block = block;
+    allocation.order = order;
+
+    if (block->mapping)
+    {
+        allocation.mappedData = static_cast<uint8_t*> (block->mapping) + offset;
+    }
+
+    *outputAllocation = allocation;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool DeviceMemoryAllocator::AllocateDedicated(const VkMemoryRequirements& requirements,
+    const int memoryTypeIndex,
+    const DeviceMemoryResourceType resourceType,
+    const VkMemoryDedicatedAllocateInfo* dedicatedAllocateInfo,
+    DeviceMemoryAllocation* outputAllocation)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    DeviceMemoryBlock* block = CreateBlock(memoryTypeIndex, resourceType,
+        requirements.size, true, dedicatedAllocateInfo);
+
+    if (!block)
+    {
+        return false;
+    }
+
+    block->allocationCount = 1;
+    block->usedBytes = requirements.size;
+    block->allocatedBytes = requirements.size;
+
+    DeviceMemoryAllocation allocation;
+    allocation.memory = block->memory;
+    allocation.offset = 0;
+    allocation.size = requirements.size;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.mappedData = block->mapping;
+    allocation.hostCoherent = block->hostCoherent;
+    allocation.block = block;
+
+    *outputAllocation = allocation;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryAllocator::Free(DeviceMemoryAllocation& allocation)
+{
+    if (!allocation.block)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    DeviceMemoryBlock* block = allocation.block;
+
+    if (block->dedicated)
+    {
+        DestroyBlock(block);
+        allocation = DeviceMemoryAllocation();
+        return;
+    }
+
+    const int orderCount = static_cast<int> (block->freeLists.size());
+
+    VkDeviceSize offset = allocation.offset;
+    int order = allocation.order;
+
+    block->usedBytes -= allocation.size;
+    block->allocatedBytes -= GetOrderSize(order);
+
+    // Merge with the buddy as long as it is free as well
+    while (order < orderCount - 1)
+    {
+        const VkDeviceSize buddy = offset ^ GetOrderSize(order);
+        auto& freeList = block->freeLists[order];
+        auto it = std::find(freeList.begin(), freeList.end(), buddy);
+
+        if (it == freeList.end())
+        {
+            break;
+        }
+
+        freeList.erase(it);
+        offset = std::min(offset, buddy);
+        ++order;
+    }
+
+    block->freeLists[order].push_back(offset);
+
+    if (--block->allocationCount == 0 && !KeepEmptyBlock(block))
+    {
+        DestroyBlock(block);
+    }
+
+    allocation = DeviceMemoryAllocation();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryAllocator::MarkDirty(const DeviceMemoryAllocation& allocation)
+{
+    MarkDirty(allocation, 0, allocation.size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryAllocator::MarkDirty(const DeviceMemoryAllocation& allocation,
+    const VkDeviceSize offset, const VkDeviceSize size)
+{
+    if (allocation.hostCoherent || !allocation.mappedData || size == 0)
+    {
+        return;
+    }
+
+    assert(offset + size <= allocation.size);
+
+    // Rounding to the atom size can at worst touch a neighbour, which is
+    // harmless. The end is clamped so the range never goes past the memory
+    // object, which is the only case where it may be unaligned.
+    const VkDeviceSize begin = ((allocation.offset + offset) / nonCoherentAtomSize_) * nonCoherentAtomSize_;
+    const VkDeviceSize end = std::min(allocation.block->size,
+        RoundToNextMultiple(allocation.offset + offset + size, nonCoherentAtomSize_));
+
+    VkMappedMemoryRange mappedMemoryRange = {};
+    mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    mappedMemoryRange.memory = allocation.memory;
+    mappedMemoryRange.offset = begin;
+    mappedMemoryRange.size = end - begin;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    dirtyRanges_.push_back(mappedMemoryRange);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryAllocator::FlushDirtyRanges()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (dirtyRanges_.empty())
+    {
+        return;
+    }
+
+    std::sort(dirtyRanges_.begin(), dirtyRanges_.end(),
+        [](const VkMappedMemoryRange& a, const VkMappedMemoryRange& b) -> bool {
+        if (a.memory != b.memory)
+        {
+            return a.memory < b.memory;
+        }
+
+        return a.offset < b.offset;
+    });
+
+    // Merge in place, ranges which overlap or touch become one
+    std::size_t mergedCount = 0;
+
+    for (std::size_t i = 1; i < dirtyRanges_.size(); ++i)
+    {
+        auto& last = dirtyRanges_[mergedCount];
+        const auto& range = dirtyRanges_[i];
+
+        if (range.memory == last.memory &&
+            range.offset <= last.offset + last.size)
+        {
+            last.size = std::max(last.offset + last.size,
+                range.offset + range.size) - last.offset;
+        }
+        else
+        {
+            dirtyRanges_[++mergedCount] = range;
+        }
+    }
+
+    dirtyRanges_.resize(mergedCount + 1);
+
+    vkFlushMappedMemoryRanges(device_,
+        static_cast<uint32_t> (dirtyRanges_.size()), dirtyRanges_.data());
+
+    dirtyRanges_.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryAllocator::GetStatistics(DeviceMemoryStatistics* outputStatistics)
+{
+    assert(outputStatistics);
+
+    DeviceMemoryStatistics statistics;
+    statistics.memoryTypeCount = static_cast<int> (memoryProperties_.Get().memoryTypeCount);
+    statistics.heapCount = memoryProperties_.GetHeapCount();
+    statistics.budgetAvailable = memoryProperties_.QueryBudget(
+        statistics.heapBudget, statistics.heapUsage);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto& block : blocks_)
+    {
+        DeviceMemoryStatistics::Entry blockEntry;
+        blockEntry.blockCount = 1;
+        blockEntry.blockBytes = block->size;
+        blockEntry.dedicatedBlockCount = block->dedicated ? 1 : 0;
+        blockEntry.allocationCount = block->allocationCount;
+        blockEntry.usedBytes = block->usedBytes;
+        blockEntry.freeBytes = block->size - block->allocatedBytes;
+
+        for (int i = static_cast<int> (block->freeLists.size()) - 1; i >= 0; --i)
+        {
+            if (!block->freeLists[i].empty())
+            {
+                blockEntry.largestFreeRange = GetOrderSize(i);
+                break;
+            }
+        }
+
+        DeviceMemoryStatistics::Entry* entries[] = {
+            &statistics.memoryTypes[block->memoryTypeIndex],
+            &statistics.heaps[memoryProperties_.GetHeapIndex(block->memoryTypeIndex)],
+            &statistics.total
+        };
+
+        for (auto entry : entries)
+        {
+            entry->blockCount += blockEntry.blockCount;
+            entry->blockBytes += blockEntry.blockBytes;
+            entry->dedicatedBlockCount += blockEntry.dedicatedBlockCount;
+            entry->allocationCount += blockEntry.allocationCount;
+            entry->usedBytes += blockEntry.usedBytes;
+            entry->freeBytes += blockEntry.freeBytes;
+            entry->largestFreeRange = std::max(entry->largestFreeRange,
+                blockEntry.largestFreeRange);
+        }
+    }
+
+    for (int i = 0; i < statistics.memoryTypeCount; ++i)
+    {
+        statistics.memoryTypes[i].peakBlockBytes = memoryTypePeakBlockBytes_[i];
+    }
+
+    for (int i = 0; i < statistics.heapCount; ++i)
+    {
+        statistics.heaps[i].peakBlockBytes = heapPeakBlockBytes_[i];
+    }
+
+    statistics.total.peakBlockBytes = totalPeakBlockBytes_;
+
+    *outputStatistics = statistics;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryAllocator::GetBlockInfos(std::vector<DeviceMemoryBlockInfo>* outputBlockInfos)
+{
+    assert(outputBlockInfos);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    outputBlockInfos->resize(blocks_.size());
+
+    for (std::size_t i = 0; i < blocks_.size(); ++i)
+    {
+        const auto& block = blocks_[i];
+        auto& blockInfo = (*outputBlockInfos)[i];
+
+        blockInfo.block = block.get();
+        blockInfo.memoryTypeIndex = block->memoryTypeIndex;
+        blockInfo.resourceType = block->resourceType;
+        blockInfo.size = block->size;
+        blockInfo.allocatedBytes = block->allocatedBytes;
+        blockInfo.allocationCount = block->allocationCount;
+        blockInfo.dedicated = block->dedicated;
+        blockInfo.evacuating = block->evacuating;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryAllocator::SetEvacuating(const DeviceMemoryBlock* block,
+    const bool evacuating)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto& candidate : blocks_)
+    {
+        if (candidate.get() == block)
+        {
+            candidate->evacuating = evacuating;
+            return;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool DeviceMemoryAllocator::AllocateForMove(const DeviceMemoryAllocation& source,
+    const VkMemoryRequirements& requirements,
+    DeviceMemoryAllocation* outputAllocation)
+{
+    assert(source.block);
+    assert(requirements.memoryTypeBits & (1u << source.memoryTypeIndex));
+
+    return AllocateFromMemoryType(requirements, source.memoryTypeIndex,
+        source.block->resourceType, false, outputAllocation);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int DeviceMemoryAllocator::ReportLeaks()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    int leakCount = 0;
+
+    for (const auto& block : blocks_)
+    {
+        if (block->allocationCount == 0)
+        {
+            continue;
+        }
+
+        DebugPrint("Leaked %d device memory allocations (%llu bytes) in a "
+            "%llu byte block of memory type %d\n",
+            block->allocationCount,
+            static_cast<unsigned long long> (block->usedBytes),
+            static_cast<unsigned long long> (block->size),
+            block->memoryTypeIndex);
+
+        leakCount += block->allocationCount;
+    }
+
+    return leakCount;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+DeviceMemoryBlock* DeviceMemoryAllocator::CreateBlock(const int memoryTypeIndex,
+    const DeviceMemoryResourceType resourceType, const VkDeviceSize size,
+    const bool dedicated, const VkMemoryDedicatedAllocateInfo* dedicatedAllocateInfo)
+{
+    VkMemoryAllocateInfo memoryAllocateInfo = {};
+    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memoryAllocateInfo.pNext = dedicatedAllocateInfo;
+    memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+    memoryAllocateInfo.allocationSize = size;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    const VkResult result = vkAllocateMemory(device_, &memoryAllocateInfo, allocationCallbacks_,
+        &memory);
+
+    if (result != VK_SUCCESS)
+    {
+        DebugPrint("vkAllocateMemory of %llu bytes from memory type %d failed (%d)\n",
+            static_cast<unsigned long long> (size), memoryTypeIndex,
+            static_cast<int> (result));
+        return nullptr;
+    }
+
+    const int heapIndex = memoryProperties_.GetHeapIndex(memoryTypeIndex);
+    memoryTypeBlockBytes_[memoryTypeIndex] += size;
+    heapBlockBytes_[heapIndex] += size;
+    totalBlockBytes_ += size;
+
+    memoryTypePeakBlockBytes_[memoryTypeIndex] = std::max(
+        memoryTypePeakBlockBytes_[memoryTypeIndex], memoryTypeBlockBytes_[memoryTypeIndex]);
+    heapPeakBlockBytes_[heapIndex] = std::max(
+        heapPeakBlockBytes_[heapIndex], heapBlockBytes_[heapIndex]);
+    totalPeakBlockBytes_ = std::max(totalPeakBlockBytes_, totalBlockBytes_);
+
+    std::unique_ptr<DeviceMemoryBlock> block(new DeviceMemoryBlock);
+    block->memory = memory;
+    block->size = size;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->resourceType = resourceType;
+
+    const VkMemoryPropertyFlags propertyFlags =
+        memoryProperties_.GetPropertyFlags(memoryTypeIndex);
+
+    if (propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        // A memory object can only be mapped once, so the block is mapped
+        // as a whole for all its allocations
+        vkMapMemory(device_, memory, 0, VK_WHOLE_SIZE, 0, &block->mapping);
+        block->hostCoherent = (propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    }
+
+    // Dedicated blocks have no free lists, so Allocate() never picks them
+    if (dedicated)
+    {
+        block->dedicated = true;
+    }
+    else
+    {
+        block->freeLists.resize(GetOrder(size) + 1);
+        block->freeLists.back().push_back(0);
+    }
+
+    blocks_.push_back(std::move(block));
+
+    return blocks_.back().get();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryAllocator::DestroyBlock(DeviceMemoryBlock* block)
+{
+    if (block->mapping)
+    {
+        vkUnmapMemory(device_, block->memory);
+    }
+
+    vkFreeMemory(device_, block->memory, allocationCallbacks_);
+
+    // Writes to memory which is gone don't need to be flushed anymore
+    dirtyRanges_.erase(std::remove_if(dirtyRanges_.begin(), dirtyRanges_.end(),
+        [block](const VkMappedMemoryRange& range) -> bool {
+        return range.memory == block->memory;
+    }), dirtyRanges_.end());
+
+    memoryTypeBlockBytes_[block->memoryTypeIndex] -= block->size;
+    heapBlockBytes_[memoryProperties_.GetHeapIndex(block->memoryTypeIndex)] -= block->size;
+    totalBlockBytes_ -= block->size;
+
+    blocks_.erase(std::find_if(blocks_.begin(), blocks_.end(),
+        [block](const std::unique_ptr<DeviceMemoryBlock>& b) -> bool {
+        return b.get() == block;
+    }));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool DeviceMemoryAllocator::KeepEmptyBlock(const DeviceMemoryBlock* block) const
+{
+    // The defragmenter empties a block to get rid of it
+    if (block->dedicated || block->evacuating)
+    {
+        return false;
+    }
+
+    for (const auto& candidate : blocks_)
+    {
+        if (candidate.get() == block || candidate->dedicated ||
+            candidate->allocationCount != 0 ||
+            candidate->memoryTypeIndex != block->memoryTypeIndex)
+        {
+            continue;
+        }
+
+        if (separateResourceTypes_ && candidate->resourceType != block->resourceType)
+        {
+            continue;
+        }
+
+        // There is already an empty block to allocate from
+        return false;
+    }
+
+    return true;
+}
+}   // namespace AMD
@@ -0,0 +1,306 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_DEVICEMEMORYALLOCATOR_H_
+#define AMD_VULKAN_SAMPLE_DEVICEMEMORYALLOCATOR_H_
+
+#include "DeviceMemoryProperties.h"
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace AMD
+{
+struct DeviceMemoryBlock;
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Whether the resource bound to an allocation is a buffer or linear image,
+* or an optimally tiled image. The two must not share a
+* bufferImageGranularity-sized page.
+*/
+enum DeviceMemoryResourceType
+{
+    DMRT_Linear,
+    DMRT_Optimal
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* A range of device memory handed out by DeviceMemoryAllocator. Bind
+* resources with memory and offset.
+*/
+struct DeviceMemoryAllocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    int memoryTypeIndex = -1;
+
+    /**
+    * Points at offset if the memory is host visible, nullptr otherwise.
+    * The block is mapped once and stays mapped, there is no need to
+    * call vkMapMemory on the allocation.
+    */
+    void* mappedData = nullptr;
+    bool hostCoherent = false;
+
+    // Owned by the allocator
+    DeviceMemoryBlock* block = nullptr;
+    int order = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Snapshot of the allocator state, see DeviceMemoryAllocator::GetStatistics().
+*/
+struct DeviceMemoryStatistics
+{
+    struct Entry
+    {
+        // Device memory objects we hold, and their total size
+        int blockCount = 0;
+        VkDeviceSize blockBytes = 0;
+        // Blocks which hold a single dedicated allocation
+        int dedicatedBlockCount = 0;
+        // Highest blockBytes so far
+        VkDeviceSize peakBlockBytes = 0;
+
+        int allocationCount = 0;
+        // Sum of the sizes the resources asked for. The difference to
+        // blockBytes - freeBytes is lost to rounding.
+        VkDeviceSize usedBytes = 0;
+        VkDeviceSize freeBytes = 0;
+        VkDeviceSize largestFreeRange = 0;
+
+        /**
+        * 0 if all free memory is in one range, approaching 1 the more it
+        * is scattered over small ranges.
+        */
+        double GetFragmentation() const
+        {
+            return freeBytes ? 1.0 - static_cast<double> (largestFreeRange) / freeBytes : 0.0;
+        }
+    };
+
+    int memoryTypeCount = 0;
+    Entry memoryTypes[VK_MAX_MEMORY_TYPES];
+
+    int heapCount = 0;
+    Entry heaps[VK_MAX_MEMORY_HEAPS];
+
+    /**
+    * From VK_EXT_memory_budget, if budgetAvailable. Otherwise, the budget
+    * is the heap size and the usage is 0.
+    */
+    bool budgetAvailable = false;
+    VkDeviceSize heapBudget[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heapUsage[VK_MAX_MEMORY_HEAPS];
+
+    Entry total;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* State of a single block, see DeviceMemoryAllocator::GetBlockInfos().
+* block identifies it, it is what DeviceMemoryAllocation::block points
+* to for allocations in this block.
+*/
+struct DeviceMemoryBlockInfo
+{
+    const DeviceMemoryBlock* block = nullptr;
+    int memoryTypeIndex = -1;
+    DeviceMemoryResourceType resourceType = DMRT_Linear;
+    VkDeviceSize size = 0;
+    // Including the rounding to powers of two
+    VkDeviceSize allocatedBytes = 0;
+    int allocationCount = 0;
+    bool dedicated = false;
+    bool evacuating = false;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Sub-allocates device memory from large blocks, so we don't call
+* vkAllocateMemory per resource and stay far away from
+* maxMemoryAllocationCount.
+*
+* Each block belongs to one memory type and is managed as a buddy
+* allocator: every allocation is rounded up to a power of two, and buddy
+* blocks are naturally aligned to their size, which covers any alignment
+* Vulkan asks for. Freed ranges are merged with their buddy right away.
+*
+* If bufferImageGranularity is larger than the smallest allocation,
+* linear and optimal resources are placed in separate blocks.
+*
+* Resources for which the driver asks for a dedicated allocation get a
+* block of their own, see AllocateForImage(). So do resources larger than
+* blockSize, with a memory object of exactly their size.
+*
+* All functions are thread-safe.
+*/
+class DeviceMemoryAllocator
+{
+public:
+    DeviceMemoryAllocator(const DeviceMemoryAllocator&) = delete;
+    DeviceMemoryAllocator& operator= (const DeviceMemoryAllocator&) = delete;
+
+    DeviceMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device,
+        const DeviceMemoryProperties& memoryProperties,
+        const VkAllocationCallbacks* allocationCallbacks = nullptr,
+        const VkDeviceSize blockSize = 64 << 20);
+    ~DeviceMemoryAllocator();
+
+    /**
+    * Allocate memory for a resource with the given requirements, from the
+    * memory type which suits usage best. If that memory type is out of
+    * memory, the next best one is tried.
+    *
+    * Returns false if no memory type matches or the device is out of
+    * memory.
+    */
+    bool Allocate(const VkMemoryRequirements& requirements,
+        const MemoryUsage usage,
+        const DeviceMemoryResourceType resourceType,
+        DeviceMemoryAllocation* outputAllocation);
+
+    /**
+    * Allocate memory for an optimally tiled image or a buffer. Asks the
+    * driver whether the resource should get a memory object of its own
+    * (VkMemoryDedicatedRequirements), which it typically does for large
+    * render targets, and allocates a dedicated block if so. Everything
+    * else is sub-allocated like with Allocate().
+    */
+    bool AllocateForImage(VkImage image, const MemoryUsage usage,
+        DeviceMemoryAllocation* outputAllocation);
+    bool AllocateForBuffer(VkBuffer buffer, const MemoryUsage usage,
+        DeviceMemoryAllocation* outputAllocation);
+
+    /**
+    * Return the allocation to its block. The GPU must be done with the
+    * allocation. Blocks which become empty are released, except for one
+    * regular sized block per memory type (and resource type, if those are
+    * kept apart), so a workload which frees and reallocates its last
+    * resource doesn't call vkAllocateMemory/vkFreeMemory every time.
+    * Evacuating blocks are always released.
+    */
+    void Free(DeviceMemoryAllocation& allocation);
+
+    /**
+    * Record a host write to the mapped allocation. Nothing is flushed
+    * yet, FlushDirtyRanges() does that for all writes at once. Does
+    * nothing for coherent memory.
+    */
+    void MarkDirty(const DeviceMemoryAllocation& allocation);
+
+    /**
+    * Record a host write of size bytes starting at offset, relative to the
+    * start of the allocation.
+    */
+    void MarkDirty(const DeviceMemoryAllocation& allocation,
+        const VkDeviceSize offset, const VkDeviceSize size);
+
+    /**
+    * Make all writes recorded since the last call visible to the device.
+    * The ranges are rounded to nonCoherentAtomSize and merged where they
+    * touch, and then flushed with a single vkFlushMappedMemoryRanges.
+    * Call this before submitting work which reads the data.
+    */
+    void FlushDirtyRanges();
+
+    void GetStatistics(DeviceMemoryStatistics* outputStatistics);
+
+    /**
+    * One entry per block, in no particular order.
+    */
+    void GetBlockInfos(std::vector<DeviceMemoryBlockInfo>* outputBlockInfos);
+
+    /**
+    * Stop placing new allocations in the block, so it can be emptied by
+    * moving its allocations elsewhere. The block is released as usual
+    * once its last allocation is freed.
+    */
+    void SetEvacuating(const DeviceMemoryBlock* block, const bool evacuating);
+
+    /**
+    * Allocate a new place for the resource bound to source, in the same
+    * memory type. Evacuating blocks are skipped, and no new block is
+    * created - moving into a fresh block would not make anything smaller.
+    * Returns false if no existing block has room.
+    */
+    bool AllocateForMove(const DeviceMemoryAllocation& source,
+        const VkMemoryRequirements& requirements,
+        DeviceMemoryAllocation* outputAllocation);
+
+    /**
+    * Print all allocations which are still alive and return their count.
+    * Call this at shutdown, once everything should have been freed.
+    */
+    int ReportLeaks();
+
+private:
+    bool Allocate(const VkMemoryRequirements& requirements,
+        const MemoryUsage usage,
+        const DeviceMemoryResourceType resourceType,
+        const VkMemoryDedicatedAllocateInfo* dedicatedAllocateInfo,
+        DeviceMemoryAllocation* outputAllocation);
+    bool AllocateFromMemoryType(const VkMemoryRequirements& requirements,
+        const int memoryTypeIndex,
+        const DeviceMemoryResourceType resourceType,
+        const bool allowNewBlock,
+        DeviceMemoryAllocation* outputAllocation);
+    bool AllocateDedicated(const VkMemoryRequirements& requirements,
+        const int memoryTypeIndex,
+        const DeviceMemoryResourceType resourceType,
+        const VkMemoryDedicatedAllocateInfo* dedicatedAllocateInfo,
+        DeviceMemoryAllocation* outputAllocation);
+    DeviceMemoryBlock* CreateBlock(const int memoryTypeIndex,
+        const DeviceMemoryResourceType resourceType, const VkDeviceSize size,
+        const bool dedicated,
+        const VkMemoryDedicatedAllocateInfo* dedicatedAllocateInfo = nullptr);
+    void DestroyBlock(DeviceMemoryBlock* block);
+    bool KeepEmptyBlock(const DeviceMemoryBlock* block) const;
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    const VkAllocationCallbacks* allocationCallbacks_ = nullptr;
+    const DeviceMemoryProperties& memoryProperties_;
+    VkDeviceSize blockSize_ = 0;
+    VkDeviceSize nonCoherentAtomSize_ = 1;
+    bool separateResourceTypes_ = false;
+
+    std::vector<std::unique_ptr<DeviceMemoryBlock>> blocks_;
+    std::vector<VkMappedMemoryRange> dirtyRanges_;
+
+    VkDeviceSize memoryTypeBlockBytes_[VK_MAX_MEMORY_TYPES] = {};
+    VkDeviceSize memoryTypePeakBlockBytes_[VK_MAX_MEMORY_TYPES] = {};
+    VkDeviceSize heapBlockBytes_[VK_MAX_MEMORY_HEAPS] = {};
+    VkDeviceSize heapPeakBlockBytes_[VK_MAX_MEMORY_HEAPS] = {};
+    VkDeviceSize totalBlockBytes_ = 0;
+    VkDeviceSize totalPeakBlockBytes_ = 0;
+
+    std::mutex mutex_;
+};
+}   // namespace AMD
+
+#endif
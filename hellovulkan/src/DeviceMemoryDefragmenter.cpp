@@ -0,0 +1,498 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "DeviceMemoryDefragmenter.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+DeviceMemoryDefragmenter::DeviceMemoryDefragmenter(VkDevice device,
+    DeviceMemoryAllocator& allocator, const VkDeviceSize bytesPerFrame,
+    const float maxOccupancy,
+    const VkAllocationCallbacks* allocationCallbacks)
+    : device_(device)
+    , allocationCallbacks_(allocationCallbacks)
+    , allocator_(allocator)
+    , bytesPerFrame_(bytesPerFrame)
+    , maxOccupancy_(maxOccupancy)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+DeviceMemoryDefragmenter::~DeviceMemoryDefragmenter()
+{
+    if (evacuatingBlock_)
+    {
+        allocator_.SetEvacuating(evacuatingBlock_, false);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int DeviceMemoryDefragmenter::RegisterBuffer(VkBuffer buffer,
+    const VkBufferCreateInfo& createInfo,
+    const DeviceMemoryAllocation& allocation,
+    const VkPipelineStageFlags stageMask, const VkAccessFlags accessMask,
+    const BufferMovedFunction& movedFunction)
+{
+    assert(createInfo.usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    assert(createInfo.usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    assert(createInfo.sharingMode == VK_SHARING_MODE_EXCLUSIVE);
+    assert(stageMask != 0);
+
+    Resource resource;
+    resource.id = nextId_++;
+    resource.buffer = buffer;
+    resource.bufferCreateInfo = createInfo;
+    resource.bufferCreateInfo.pNext = nullptr;
+    resource.bufferCreateInfo.queueFamilyIndexCount = 0;
+    resource.bufferCreateInfo.pQueueFamilyIndices = nullptr;
+    resource.bufferMovedFunction = movedFunction;
+    resource.stageMask = stageMask;
+    resource.accessMask = accessMask;
+    resource.allocation = allocation;
+
+    resources_.push_back(resource);
+
+    return resource.id;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int DeviceMemoryDefragmenter::RegisterImage(VkImage image,
+    const VkImageCreateInfo& createInfo,
+    const DeviceMemoryAllocation& allocation,
+    const VkImageAspectFlags aspectMask, const VkImageLayout layout,
+    const VkPipelineStageFlags stageMask, const VkAccessFlags accessMask,
+    const ImageMovedFunction& movedFunction)
+{
+    assert(createInfo.usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    assert(createInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    assert(createInfo.sharingMode == VK_SHARING_MODE_EXCLUSIVE);
+    assert(createInfo.samples == VK_SAMPLE_COUNT_1_BIT);
+    assert(stageMask != 0);
+
+    Resource resource;
+    resource.id = nextId_++;
+    resource.image = image;
+    resource.imageCreateInfo = createInfo;
+    resource.imageCreateInfo.pNext = nullptr;
+    resource.imageCreateInfo.queueFamilyIndexCount = 0;
+    resource.imageCreateInfo.pQueueFamilyIndices = nullptr;
+    // The contents come from the copy
+    resource.imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resource.aspectMask = aspectMask;
+    resource.layout = layout;
+    resource.imageMovedFunction = movedFunction;
+    resource.stageMask = stageMask;
+    resource.accessMask = accessMask;
+    resource.allocation = allocation;
+
+    resources_.push_back(resource);
+
+    return resource.id;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryDefragmenter::Unregister(const int id)
+{
+    resources_.erase(std::remove_if(resources_.begin(), resources_.end(),
+        [id](const Resource& resource) -> bool {
+        return resource.id == id;
+    }), resources_.end());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool DeviceMemoryDefragmenter::BeginFrame()
+{
+    if (!evacuatingBlock_)
+    {
+        if (retryDelay_ > 0)
+        {
+            --retryDelay_;
+            return false;
+        }
+
+        SelectBlock();
+
+        if (!evacuatingBlock_)
+        {
+            retryDelay_ = RetryInterval;
+            return false;
+        }
+    }
+
+    for (const auto& resource : resources_)
+    {
+        if (resource.allocation.block == evacuatingBlock_)
+        {
+            return true;
+        }
+    }
+
+    // Everything has moved out. The block is released together with the
+    // last old allocation, once the frame which copied it retires.
+    evacuatingBlock_ = nullptr;
+    ++statistics_.evacuatedBlockCount;
+
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int DeviceMemoryDefragmenter::Record(VkCommandBuffer commandBuffer)
+{
+    struct Move
+    {
+        std::size_t resourceIndex;
+        VkBuffer buffer;
+        VkImage image;
+        DeviceMemoryAllocation allocation;
+    };
+
+    std::vector<Move> moves;
+    VkDeviceSize movedBytes = 0;
+
+    for (std::size_t i = 0; i < resources_.size() && evacuatingBlock_; ++i)
+    {
+        const auto& resource = resources_[i];
+
+        if (resource.allocation.block != evacuatingBlock_)
+        {
+            continue;
+        }
+
+        // At least one move per frame, so resources larger than the
+        // budget move eventually
+        if (!moves.empty() && movedBytes + resource.allocation.size > bytesPerFrame_)
+        {
+            break;
+        }
+
+        Move move;
+        move.resourceIndex = i;
+
+        if (!CreateReplacement(resource, &move.buffer, &move.image, &move.allocation))
+        {
+            AbortPass();
+            break;
+        }
+
+        moves.push_back(move);
+        movedBytes += resource.allocation.size;
+    }
+
+    if (moves.empty())
+    {
+        return 0;
+    }
+
+    // Images change layouts for the copy. For buffers, the earlier upload
+    // made its writes visible to the usual reads, not to transfers.
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    VkPipelineStageFlags stageMask = 0;
+
+    for (const auto& move : moves)
+    {
+        const auto& resource = resources_[move.resourceIndex];
+        stageMask |= resource.stageMask;
+
+        if (resource.image == VK_NULL_HANDLE)
+        {
+            continue;
+        }
+
+        VkImageMemoryBarrier imageBarrier = {};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.subresourceRange.aspectMask = resource.aspectMask;
+        imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+        imageBarrier.image = resource.image;
+        imageBarrier.oldLayout = resource.layout;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        imageBarriers.push_back(imageBarrier);
+
+        imageBarrier.image = move.image;
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageBarriers.push_back(imageBarrier);
+    }
+
+    vkCmdPipelineBarrier(commandBuffer,
+        stageMask,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr,
+        static_cast<uint32_t> (imageBarriers.size()), imageBarriers.data());
+
+    std::vector<VkImageCopy> imageCopies;
+
+    for (const auto& move : moves)
+    {
+        const auto& resource = resources_[move.resourceIndex];
+
+        if (resource.buffer != VK_NULL_HANDLE)
+        {
+            VkBufferCopy bufferCopy = {};
+            bufferCopy.size = resource.bufferCreateInfo.size;
+
+            vkCmdCopyBuffer(commandBuffer, resource.buffer, move.buffer,
+                1, &bufferCopy);
+            continue;
+        }
+
+        const auto& createInfo = resource.imageCreateInfo;
+        imageCopies.resize(createInfo.mipLevels);
+
+        for (uint32_t level = 0; level < createInfo.mipLevels; ++level)
+        {
+            VkImageCopy& imageCopy = imageCopies[level];
+            imageCopy = VkImageCopy();
+            imageCopy.srcSubresource.aspectMask = resource.aspectMask;
+            imageCopy.srcSubresource.mipLevel = level;
+            imageCopy.srcSubresource.layerCount = createInfo.arrayLayers;
+            imageCopy.dstSubresource = imageCopy.srcSubresource;
+            imageCopy.extent.width = std::max(createInfo.extent.width >> level, 1u);
+            imageCopy.extent.height = std::max(createInfo.extent.height >> level, 1u);
+            imageCopy.extent.depth = std::max(createInfo.extent.depth >> level, 1u);
+        }
+
+        vkCmdCopyImage(commandBuffer,
+            resource.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            move.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t> (imageCopies.size()), imageCopies.data());
+    }
+
+    // Make the copies visible to the uses of the new resources
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    imageBarriers.clear();
+
+    for (const auto& move : moves)
+    {
+        const auto& resource = resources_[move.resourceIndex];
+
+        if (resource.buffer != VK_NULL_HANDLE)
+        {
+            VkBufferMemoryBarrier bufferBarrier = {};
+            bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            bufferBarrier.dstAccessMask = resource.accessMask;
+            bufferBarrier.buffer = move.buffer;
+            bufferBarrier.size = VK_WHOLE_SIZE;
+            bufferBarriers.push_back(bufferBarrier);
+        }
+        else
+        {
+            VkImageMemoryBarrier imageBarrier = {};
+            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.subresourceRange.aspectMask = resource.aspectMask;
+            imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+            imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+            imageBarrier.image = move.image;
+            imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            imageBarrier.newLayout = resource.layout;
+            imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            imageBarrier.dstAccessMask = resource.accessMask;
+            imageBarriers.push_back(imageBarrier);
+        }
+    }
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        stageMask, 0,
+        0, nullptr,
+        static_cast<uint32_t> (bufferBarriers.size()), bufferBarriers.data(),
+        static_cast<uint32_t> (imageBarriers.size()), imageBarriers.data());
+
+    for (const auto& move : moves)
+    {
+        auto& resource = resources_[move.resourceIndex];
+
+        ++statistics_.moveCount;
+        statistics_.movedBytes += resource.allocation.size;
+
+        resource.allocation = move.allocation;
+
+        if (resource.buffer != VK_NULL_HANDLE)
+        {
+            resource.buffer = move.buffer;
+            resource.bufferMovedFunction(move.buffer, move.allocation);
+        }
+        else
+        {
+            resource.image = move.image;
+            resource.imageMovedFunction(move.image, move.allocation);
+        }
+    }
+
+    return static_cast<int> (moves.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryDefragmenter::GetStatistics(
+    DefragmentationStatistics* outputStatistics) const
+{
+    assert(outputStatistics);
+
+    *outputStatistics = statistics_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryDefragmenter::SelectBlock()
+{
+    allocator_.GetBlockInfos(&blockInfos_);
+
+    const DeviceMemoryBlockInfo* selected = nullptr;
+
+    for (const auto& candidate : blockInfos_)
+    {
+        if (candidate.dedicated || candidate.evacuating ||
+            candidate.allocationCount == 0)
+        {
+            continue;
+        }
+
+        if (candidate.allocatedBytes > candidate.size * maxOccupancy_)
+        {
+            continue;
+        }
+
+        // Only blocks which can be emptied completely are worth moving
+        // anything for
+        int registeredCount = 0;
+
+        for (const auto& resource : resources_)
+        {
+            if (resource.allocation.block == candidate.block)
+            {
+                ++registeredCount;
+            }
+        }
+
+        if (registeredCount != candidate.allocationCount)
+        {
+            continue;
+        }
+
+        VkDeviceSize freeBytes = 0;
+
+        for (const auto& other : blockInfos_)
+        {
+            if (&other == &candidate || other.dedicated || other.evacuating ||
+                other.memoryTypeIndex != candidate.memoryTypeIndex ||
+                other.resourceType != candidate.resourceType)
+            {
+                continue;
+            }
+
+            freeBytes += other.size - other.allocatedBytes;
+        }
+
+        if (freeBytes < candidate.allocatedBytes)
+        {
+            continue;
+        }
+
+        // Least to copy first
+        if (!selected || candidate.allocatedBytes < selected->allocatedBytes)
+        {
+            selected = &candidate;
+        }
+    }
+
+    if (selected)
+    {
+        evacuatingBlock_ = selected->block;
+        allocator_.SetEvacuating(evacuatingBlock_, true);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryDefragmenter::AbortPass()
+{
+    // The free space of the other blocks is too scattered. Whatever moved
+    // so far stays where it is, and the block is open for allocations
+    // again.
+    allocator_.SetEvacuating(evacuatingBlock_, false);
+    evacuatingBlock_ = nullptr;
+    retryDelay_ = RetryInterval;
+
+    ++statistics_.abortedPassCount;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool DeviceMemoryDefragmenter::CreateReplacement(const Resource& resource,
+    VkBuffer* outputBuffer, VkImage* outputImage,
+    DeviceMemoryAllocation* outputAllocation)
+{
+    *outputBuffer = VK_NULL_HANDLE;
+    *outputImage = VK_NULL_HANDLE;
+
+    VkMemoryRequirements memoryRequirements = {};
+
+    if (resource.buffer != VK_NULL_HANDLE)
+    {
+        vkCreateBuffer(device_, &resource.bufferCreateInfo, allocationCallbacks_,
+            outputBuffer);
+        vkGetBufferMemoryRequirements(device_, *outputBuffer, &memoryRequirements);
+    }
+    else
+    {
+        vkCreateImage(device_, &resource.imageCreateInfo, allocationCallbacks_,
+            outputImage);
+        vkGetImageMemoryRequirements(device_, *outputImage, &memoryRequirements);
+    }
+
+    if (!allocator_.AllocateForMove(resource.allocation, memoryRequirements,
+        outputAllocation))
+    {
+        // Never used by the device, no need to defer
+        vkDestroyBuffer(device_, *outputBuffer, allocationCallbacks_);
+        vkDestroyImage(device_, *outputImage, allocationCallbacks_);
+        return false;
+    }
+
+    if (*outputBuffer != VK_NULL_HANDLE)
+    {
+        vkBindBufferMemory(device_, *outputBuffer, outputAllocation->memory,
+            outputAllocation->offset);
+    }
+    else
+    {
+        vkBindImageMemory(device_, *outputImage, outputAllocation->memory,
+            outputAllocation->offset);
+    }
+
+    return true;
+}
+}   // namespace AMD
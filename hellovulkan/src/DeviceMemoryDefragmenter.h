@@ -0,0 +1,191 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_DEVICEMEMORYDEFRAGMENTER_H_
+#define AMD_VULKAN_SAMPLE_DEVICEMEMORYDEFRAGMENTER_H_
+
+#include "DeviceMemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <vector>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+/**
+* What the defragmenter did so far, see DeviceMemoryDefragmenter.
+*/
+struct DefragmentationStatistics
+{
+    // Blocks which were emptied completely, and are released once the
+    // frames which moved their resources retire
+    int evacuatedBlockCount = 0;
+    // Passes given up because the remaining blocks had no room
+    int abortedPassCount = 0;
+    int moveCount = 0;
+    VkDeviceSize movedBytes = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Called with the replacement resource and its memory after a move. The
+* owner takes over both, and replaces the old ones through the deletion
+* queue - the copy is recorded into the current frame, so the old
+* resource must stay alive until that frame retires. Views and
+* descriptors referencing the old resource must be recreated as well.
+*/
+typedef std::function<void (VkBuffer buffer,
+    const DeviceMemoryAllocation& allocation)> BufferMovedFunction;
+typedef std::function<void (VkImage image,
+    const DeviceMemoryAllocation& allocation)> ImageMovedFunction;
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Compacts device memory incrementally, so long-running processes which
+* keep loading and freeing resources don't accumulate sparse blocks.
+*
+* Resources must be registered to be movable. Once a block is at most
+* maxOccupancy full, all of its allocations belong to registered
+* resources, and the other blocks of its memory type have room for them,
+* the block is marked as evacuating. Every frame, up to bytesPerFrame of
+* its resources are then recreated elsewhere and copied on the GPU with
+* vkCmdCopyBuffer and vkCmdCopyImage. Once the block is empty, the
+* allocator releases it.
+*
+* Dedicated allocations are never moved. Buffers need TRANSFER_SRC and
+* TRANSFER_DST usage, images as well, and they must use exclusive
+* sharing.
+*
+* Not thread-safe, use it from the thread which submits frames.
+*/
+class DeviceMemoryDefragmenter
+{
+public:
+    DeviceMemoryDefragmenter(const DeviceMemoryDefragmenter&) = delete;
+    DeviceMemoryDefragmenter& operator= (const DeviceMemoryDefragmenter&) = delete;
+
+    DeviceMemoryDefragmenter(VkDevice device, DeviceMemoryAllocator& allocator,
+        const VkDeviceSize bytesPerFrame,
+        const float maxOccupancy = 0.5f,
+        const VkAllocationCallbacks* allocationCallbacks = nullptr);
+    ~DeviceMemoryDefragmenter();
+
+    /**
+    * Register a buffer bound to allocation. stageMask and accessMask
+    * describe how the buffer is used between frames, the copy
+    * synchronizes with them. Returns an id for Unregister().
+    */
+    int RegisterBuffer(VkBuffer buffer, const VkBufferCreateInfo& createInfo,
+        const DeviceMemoryAllocation& allocation,
+        const VkPipelineStageFlags stageMask, const VkAccessFlags accessMask,
+        const BufferMovedFunction& movedFunction);
+
+    /**
+    * Register an image bound to allocation, which stays in layout between
+    * frames. All mip levels and array layers are moved.
+    */
+    int RegisterImage(VkImage image, const VkImageCreateInfo& createInfo,
+        const DeviceMemoryAllocation& allocation,
+        const VkImageAspectFlags aspectMask, const VkImageLayout layout,
+        const VkPipelineStageFlags stageMask, const VkAccessFlags accessMask,
+        const ImageMovedFunction& movedFunction);
+
+    /**
+    * Call before freeing a registered resource while frames are still
+    * running. Registrations left at shutdown go away with the
+    * defragmenter.
+    */
+    void Unregister(const int id);
+
+    /**
+    * Pick a block to evacuate if there is none yet. Returns true if
+    * there is something to move in this frame, in which case Record()
+    * must be called.
+    */
+    bool BeginFrame();
+
+    /**
+    * Record the copies for this frame, and call the moved functions of the
+    * resources which were moved. Must be submitted before anything which
+    * uses the moved resources in this frame. Returns the number of moves.
+    *
+    * The moved functions must not register or unregister resources.
+    */
+    int Record(VkCommandBuffer commandBuffer);
+
+    void GetStatistics(DefragmentationStatistics* outputStatistics) const;
+
+private:
+    struct Resource
+    {
+        int id = 0;
+
+        // Either buffer or image is set
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkBufferCreateInfo bufferCreateInfo;
+        BufferMovedFunction bufferMovedFunction;
+
+        VkImage image = VK_NULL_HANDLE;
+        VkImageCreateInfo imageCreateInfo;
+        VkImageAspectFlags aspectMask = 0;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        ImageMovedFunction imageMovedFunction;
+
+        VkPipelineStageFlags stageMask = 0;
+        VkAccessFlags accessMask = 0;
+
+        DeviceMemoryAllocation allocation;
+    };
+
+    void SelectBlock();
+    void AbortPass();
+    bool CreateReplacement(const Resource& resource, VkBuffer* outputBuffer,
+        VkImage* outputImage, DeviceMemoryAllocation* outputAllocation);
+
+    enum
+    {
+        // Frames between looking for a sparse block, when there was none
+        // or the last pass had to be aborted
+        RetryInterval = 64
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    const VkAllocationCallbacks* allocationCallbacks_ = nullptr;
+    DeviceMemoryAllocator& allocator_;
+    VkDeviceSize bytesPerFrame_ = 0;
+    float maxOccupancy_ = 0.5f;
+
+    std::vector<Resource> resources_;
+    int nextId_ = 1;
+
+    const DeviceMemoryBlock* evacuatingBlock_ = nullptr;
+    int retryDelay_ = 0;
+
+    // Kept around so selecting a block does not allocate every frame
+    std::vector<DeviceMemoryBlockInfo> blockInfos_;
+
+    DefragmentationStatistics statistics_;
+};
+}   // namespace AMD
+
+#endif
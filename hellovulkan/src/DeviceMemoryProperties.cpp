@@ -0,0 +1,242 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "DeviceMemoryProperties.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace AMD
+{
+namespace
+{
+///////////////////////////////////////////////////////////////////////////////
+int CountBits(uint32_t value)
+{
+    int result = 0;
+
+    while (value)
+    {
+        value &= value - 1;
+        ++result;
+    }
+
+    return result;
+}
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+DeviceMemoryProperties::DeviceMemoryProperties(VkPhysicalDevice physicalDevice,
+    const bool memoryBudgetEnabled)
+    : physicalDevice_(physicalDevice)
+    , memoryBudgetEnabled_(memoryBudgetEnabled)
+{
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool DeviceMemoryProperties::QueryBudget(VkDeviceSize* heapBudget,
+    VkDeviceSize* heapUsage) const
+{
+    assert(heapBudget);
+    assert(heapUsage);
+
+    for (int i = 0; i < VK_MAX_MEMORY_HEAPS; ++i)
+    {
+        heapBudget[i] = (i < GetHeapCount()) ? memoryProperties_.memoryHeaps[i].size : 0;
+        heapUsage[i] = 0;
+    }
+
+    if (!memoryBudgetEnabled_)
+    {
+        return false;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 memoryProperties2 = {};
+    memoryProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memoryProperties2.pNext = &budgetProperties;
+
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice_, &memoryProperties2);
+
+    for (int i = 0; i < GetHeapCount(); ++i)
+    {
+        heapBudget[i] = budgetProperties.heapBudget[i];
+        heapUsage[i] = budgetProperties.heapUsage[i];
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+VkDeviceSize DeviceMemoryProperties::GetHostVisibleDeviceLocalSize() const
+{
+    const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+
+    VkDeviceSize result = 0;
+
+    for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; ++i)
+    {
+        if ((memoryProperties_.memoryTypes[i].propertyFlags & flags) == flags)
+        {
+            result = std::max(result, GetHeapSize(static_cast<int> (i)));
+        }
+    }
+
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int DeviceMemoryProperties::FindMemoryType(const uint32_t memoryTypeBits,
+    const VkMemoryPropertyFlags requiredFlags,
+    const VkMemoryPropertyFlags preferredFlags,
+    const VkMemoryPropertyFlags avoidedFlags,
+    const VkDeviceSize size) const
+{
+    int bestIndex = -1;
+    int bestScore = 0;
+    VkDeviceSize bestHeapSize = 0;
+
+    for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; ++i)
+    {
+        if ((memoryTypeBits & (1u << i)) == 0)
+        {
+            continue;
+        }
+
+        const VkMemoryPropertyFlags flags = memoryProperties_.memoryTypes[i].propertyFlags;
+
+        if ((flags & requiredFlags) != requiredFlags)
+        {
+            continue;
+        }
+
+        const VkDeviceSize heapSize = GetHeapSize(static_cast<int> (i));
+
+        if (heapSize < size)
+        {
+            continue;
+        }
+
+        const int score = CountBits(flags & preferredFlags)
+            - CountBits(flags & avoidedFlags);
+
+        if (bestIndex == -1 || score > bestScore ||
+            (score == bestScore && heapSize > bestHeapSize))
+        {
+            bestIndex = static_cast<int> (i);
+            bestScore = score;
+            bestHeapSize = heapSize;
+        }
+    }
+
+    return bestIndex;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int DeviceMemoryProperties::FindMemoryType(const uint32_t memoryTypeBits,
+    const MemoryUsage usage, const VkDeviceSize size) const
+{
+    VkMemoryPropertyFlags requiredFlags, preferredFlags, avoidedFlags;
+    GetMemoryUsageFlags(usage, &requiredFlags, &preferredFlags, &avoidedFlags);
+
+    if (usage == MU_GpuToCpu)
+    {
+        // Caching is what makes the reads fast, coherency only saves an
+        // invalidate, so any cached type beats the best uncached one.
+        // Coherency still breaks the tie between cached types.
+        const int index = FindMemoryType(memoryTypeBits,
+            requiredFlags | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, preferredFlags,
+            avoidedFlags, size);
+
+        if (index != -1)
+        {
+            return index;
+        }
+    }
+
+    return FindMemoryType(memoryTypeBits, requiredFlags, preferredFlags,
+        avoidedFlags, size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void DeviceMemoryProperties::GetMemoryUsageFlags(const MemoryUsage usage,
+    VkMemoryPropertyFlags* requiredFlags,
+    VkMemoryPropertyFlags* preferredFlags,
+    VkMemoryPropertyFlags* avoidedFlags)
+{
+    assert(requiredFlags);
+    assert(preferredFlags);
+    assert(avoidedFlags);
+
+    *requiredFlags = 0;
+    *preferredFlags = 0;
+    *avoidedFlags = 0;
+
+    switch (usage)
+    {
+    case MU_GpuOnly:
+        // Not required, software implementations may not have any device
+        // local memory. Host visible device local memory is left for the
+        // resources which need it.
+        *preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        *avoidedFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        break;
+
+    case MU_CpuToGpu:
+        // Write-combined system memory is best for streaming writes, cached
+        // memory only helps if the CPU reads
+        *requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        *preferredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        *avoidedFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+            | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        break;
+
+    case MU_CpuToGpuDeviceLocal:
+        *requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+            | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        *preferredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        *avoidedFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        break;
+
+    case MU_GpuToCpu:
+        // Uncached reads are painfully slow, FindMemoryType() puts cached
+        // types first for this usage
+        *requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        *preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+            | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        *avoidedFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        break;
+
+    case MU_TransientAttachment:
+        // Lazily allocated memory is only allowed for images with
+        // TRANSIENT_ATTACHMENT usage, so it is never required here
+        *preferredFlags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+            | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        *avoidedFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        break;
+    }
+}
+}   // namespace AMD
@@ -0,0 +1,151 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_DEVICEMEMORYPROPERTIES_H_
+#define AMD_VULKAN_SAMPLE_DEVICEMEMORYPROPERTIES_H_
+
+#include <vulkan/vulkan.h>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+/**
+* How the CPU and GPU access a resource. Used to pick a memory type.
+*/
+enum MemoryUsage
+{
+    // Only accessed by the GPU. Render targets, textures, static meshes.
+    MU_GpuOnly,
+    // Written by the CPU, read by the GPU: staging and streamed data. Lands
+    // in system memory unless there is nothing else.
+    MU_CpuToGpu,
+    // Written by the CPU directly into device local memory, through the
+    // small (or resizable) BAR window. Only use this if you mean it.
+    MU_CpuToGpuDeviceLocal,
+    // Written by the GPU, read back by the CPU. Prefers cached memory.
+    MU_GpuToCpu,
+    // Attachments which never leave the render pass. Prefers lazily
+    // allocated memory, which tilers don't back with physical pages.
+    MU_TransientAttachment
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* The memory types and heaps of a physical device, queried once.
+*
+* FindMemoryType() scores every allowed type against preferred and avoided
+* property flags, instead of taking the first one which happens to have the
+* required flags. The first match is often the wrong one - for instance,
+* the DEVICE_LOCAL | HOST_VISIBLE type is usually listed before plain
+* system memory, and streaming CPU writes into it eats into the BAR window.
+*/
+class DeviceMemoryProperties
+{
+public:
+    /**
+    * Pass memoryBudgetEnabled if the device was created with
+    * VK_EXT_memory_budget, otherwise QueryBudget() reports the heap sizes.
+    */
+    DeviceMemoryProperties(VkPhysicalDevice physicalDevice,
+        const bool memoryBudgetEnabled);
+
+    /**
+    * Return the index of the best memory type in memoryTypeBits which has
+    * all requiredFlags, and whose heap can hold size bytes. Each preferred
+    * flag present counts for the type, each avoided one against it. Ties
+    * go to the larger heap.
+    *
+    * Returns -1 if no type qualifies.
+    */
+    int FindMemoryType(const uint32_t memoryTypeBits,
+        const VkMemoryPropertyFlags requiredFlags,
+        const VkMemoryPropertyFlags preferredFlags,
+        const VkMemoryPropertyFlags avoidedFlags,
+        const VkDeviceSize size = 0) const;
+
+    int FindMemoryType(const uint32_t memoryTypeBits, const MemoryUsage usage,
+        const VkDeviceSize size = 0) const;
+
+    /**
+    * Translate a usage into required, preferred and avoided flags.
+    */
+    static void GetMemoryUsageFlags(const MemoryUsage usage,
+        VkMemoryPropertyFlags* requiredFlags,
+        VkMemoryPropertyFlags* preferredFlags,
+        VkMemoryPropertyFlags* avoidedFlags);
+
+    VkMemoryPropertyFlags GetPropertyFlags(const int memoryTypeIndex) const
+    {
+        return memoryProperties_.memoryTypes[memoryTypeIndex].propertyFlags;
+    }
+
+    int GetHeapIndex(const int memoryTypeIndex) const
+    {
+        return static_cast<int> (memoryProperties_.memoryTypes[memoryTypeIndex].heapIndex);
+    }
+
+    VkDeviceSize GetHeapSize(const int memoryTypeIndex) const
+    {
+        return memoryProperties_.memoryHeaps[GetHeapIndex(memoryTypeIndex)].size;
+    }
+
+    int GetHeapCount() const
+    {
+        return static_cast<int> (memoryProperties_.memoryHeapCount);
+    }
+
+    const VkPhysicalDeviceMemoryProperties& Get() const
+    {
+        return memoryProperties_;
+    }
+
+    bool IsMemoryBudgetSupported() const
+    {
+        return memoryBudgetEnabled_;
+    }
+
+    /**
+    * Size of the largest heap with a DEVICE_LOCAL | HOST_VISIBLE memory
+    * type, 0 if there is none. Without resizable BAR, this is the 256 MiB
+    * window - which the driver uses as well.
+    */
+    VkDeviceSize GetHostVisibleDeviceLocalSize() const;
+
+    /**
+    * Fill heapBudget and heapUsage, which must have room for
+    * VK_MAX_MEMORY_HEAPS entries, with what the driver reports right now.
+    * The budget accounts for other processes, and usage includes all
+    * allocations of this process, not just ours.
+    *
+    * Without VK_EXT_memory_budget, the budget is the heap size and the
+    * usage is unknown (0), and false is returned.
+    */
+    bool QueryBudget(VkDeviceSize* heapBudget, VkDeviceSize* heapUsage) const;
+
+private:
+    VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties_;
+    bool memoryBudgetEnabled_ = false;
+};
+}   // namespace AMD
+
+#endif
@@ -0,0 +1,104 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "FrameScheduler.h"
+
+#include <cassert>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+FrameScheduler::FrameScheduler(VkDevice device, const int framesInFlight,
+    const VkAllocationCallbacks* allocationCallbacks)
+    : device_(device)
+    , allocationCallbacks_(allocationCallbacks)
+    , framesInFlight_(framesInFlight)
+{
+    assert(framesInFlight > 0);
+
+    VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {};
+    semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeCreateInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+
+    vkCreateSemaphore(device_, &semaphoreCreateInfo, allocationCallbacks_,
+        &timelineSemaphore_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+FrameScheduler::~FrameScheduler()
+{
+    vkDestroySemaphore(device_, timelineSemaphore_, allocationCallbacks_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+uint64_t FrameScheduler::BeginFrame()
+{
+    ++currentFrame_;
+
+    if (currentFrame_ > static_cast<uint64_t> (framesInFlight_))
+    {
+        WaitForFrame(currentFrame_ - framesInFlight_);
+    }
+
+    return currentFrame_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+uint64_t FrameScheduler::GetRetiredFrame() const
+{
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(device_, timelineSemaphore_, &value);
+
+    return value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool FrameScheduler::IsFrameRetired(const uint64_t frame) const
+{
+    return GetRetiredFrame() >= frame;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void FrameScheduler::WaitForFrame(const uint64_t frame) const
+{
+    assert(frame <= currentFrame_);
+
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timelineSemaphore_;
+    waitInfo.pValues = &frame;
+
+    vkWaitSemaphores(device_, &waitInfo, UINT64_MAX);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void FrameScheduler::WaitIdle() const
+{
+    WaitForFrame(currentFrame_);
+}
+}   // namespace AMD
@@ -0,0 +1,112 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_FRAMESCHEDULER_H_
+#define AMD_VULKAN_SAMPLE_FRAMESCHEDULER_H_
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Tracks frames using a single timeline semaphore. Every frame gets a
+* monotonically increasing value, the last submission of a frame signals
+* it, and the frame is retired once the semaphore reaches that value.
+*
+* Frame values start at 1, 0 means "nothing submitted yet" and is always
+* retired.
+*/
+class FrameScheduler
+{
+public:
+    FrameScheduler(const FrameScheduler&) = delete;
+    FrameScheduler& operator= (const FrameScheduler&) = delete;
+
+    FrameScheduler(VkDevice device, const int framesInFlight,
+        const VkAllocationCallbacks* allocationCallbacks = nullptr);
+    ~FrameScheduler();
+
+    /**
+    * Start a new frame and return its value. Blocks until the frame which
+    * used the same slot - framesInFlight frames ago - has retired.
+    */
+    uint64_t BeginFrame();
+
+    /**
+    * Value of the frame started by the last BeginFrame() call.
+    */
+    uint64_t GetCurrentFrame() const
+    {
+        return currentFrame_;
+    }
+
+    /**
+    * Slot of the current frame, in the range [0, GetFramesInFlight()).
+    */
+    int GetFrameSlot() const
+    {
+        return static_cast<int> (currentFrame_ % framesInFlight_);
+    }
+
+    int GetFramesInFlight() const
+    {
+        return framesInFlight_;
+    }
+
+    /**
+    * Semaphore to signal with GetCurrentFrame() on the frame's last
+    * submission.
+    */
+    VkSemaphore GetTimelineSemaphore() const
+    {
+        return timelineSemaphore_;
+    }
+
+    /**
+    * Value of the most recent frame the GPU has finished. Does not block.
+    */
+    uint64_t GetRetiredFrame() const;
+
+    bool IsFrameRetired(const uint64_t frame) const;
+
+    /**
+    * Block until the given frame has retired.
+    */
+    void WaitForFrame(const uint64_t frame) const;
+
+    /**
+    * Block until all frames started so far have retired.
+    */
+    void WaitIdle() const;
+
+private:
+    VkDevice device_ = VK_NULL_HANDLE;
+    const VkAllocationCallbacks* allocationCallbacks_ = nullptr;
+    VkSemaphore timelineSemaphore_ = VK_NULL_HANDLE;
+    int framesInFlight_ = 0;
+    uint64_t currentFrame_ = 0;
+};
+}   // namespace AMD
+
+#endif
@@ -0,0 +1,439 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "HostAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+namespace AMD
+{
+namespace
+{
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Stored right in front of every pointer handed out, so Free() and
+* Reallocate() know where it came from.
+*/
+struct AllocationHeader
+{
+    // Distance from the start of the block to the returned pointer
+    uint32_t offset;
+    // Size class, or one of the AllocationKind values
+    int32_t sizeClass;
+    uint64_t size;
+};
+
+static_assert(sizeof(AllocationHeader) == 16,
+    "The allocation header must fit into the minimum alignment");
+
+enum AllocationKind
+{
+    AK_Large = -1,
+    AK_Linear = -2
+};
+
+// Every block is at least this aligned, which leaves room for the header
+const std::size_t MinAlignment = 16;
+
+///////////////////////////////////////////////////////////////////////////////
+uint8_t* AlignPointer(uint8_t* pointer, const std::size_t alignment)
+{
+    const uintptr_t value = reinterpret_cast<uintptr_t> (pointer);
+    return reinterpret_cast<uint8_t*> ((value + alignment - 1) & ~(alignment - 1));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+AllocationHeader* GetHeader(void* memory)
+{
+    return reinterpret_cast<AllocationHeader*> (
+        static_cast<uint8_t*> (memory) - sizeof(AllocationHeader));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Place an allocation of size bytes into the block at base, and write its
+* header. The block must have room for size + alignment bytes, or
+* size + alignment + MinAlignment if base is not aligned to MinAlignment.
+*/
+void* PlaceAllocation(uint8_t* base, const std::size_t size,
+    const std::size_t alignment, const int sizeClass)
+{
+    uint8_t* result = AlignPointer(base + sizeof(AllocationHeader), alignment);
+
+    AllocationHeader* header = GetHeader(result);
+    header->offset = static_cast<uint32_t> (result - base);
+    header->sizeClass = sizeClass;
+    header->size = size;
+
+    return result;
+}
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+HostAllocator::HostAllocator(const std::size_t linearScopeSize)
+    : linearScopeSize_(linearScopeSize)
+{
+    callbacks_.pUserData = this;
+    callbacks_.pfnAllocation = AllocationFunction;
+    callbacks_.pfnReallocation = ReallocationFunction;
+    callbacks_.pfnFree = FreeFunction;
+    callbacks_.pfnInternalAllocation = InternalAllocationNotification;
+    callbacks_.pfnInternalFree = InternalFreeNotification;
+
+    for (int i = 0; i < SizeClassCount; ++i)
+    {
+        freeLists_[i] = nullptr;
+    }
+
+    if (linearScopeSize_ > 0)
+    {
+        linearScope_ = static_cast<uint8_t*> (std::malloc(linearScopeSize_));
+        ++statistics_.systemAllocationCount;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+HostAllocator::~HostAllocator()
+{
+    // Whatever the driver did not free is gone with the chunks, large
+    // allocations would leak - but then the driver leaked them first
+    for (auto chunk : chunks_)
+    {
+        std::free(chunk);
+    }
+
+    std::free(linearScope_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void HostAllocator::BeginFrame()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (liveLinearAllocationCount_ == 0)
+    {
+        linearScopeHead_ = 0;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void HostAllocator::GetStatistics(HostAllocationStatistics* outputStatistics) const
+{
+    assert(outputStatistics);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    *outputStatistics = statistics_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void* HostAllocator::Allocate(const std::size_t size, const std::size_t alignment,
+    const VkSystemAllocationScope allocationScope)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    ++statistics_.scopes[allocationScope].allocationCount;
+
+    void* result = nullptr;
+
+    if (allocationScope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND)
+    {
+        result = AllocateLinear(size, alignment);
+    }
+
+    if (!result)
+    {
+        result = AllocatePooled(size, alignment);
+    }
+
+    if (result)
+    {
+        statistics_.currentBytes += size;
+        statistics_.peakBytes = std::max(statistics_.peakBytes,
+            statistics_.currentBytes);
+    }
+
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void* HostAllocator::Reallocate(void* original, const std::size_t size,
+    const std::size_t alignment, const VkSystemAllocationScope allocationScope)
+{
+    if (!original)
+    {
+        return Allocate(size, alignment, allocationScope);
+    }
+
+    if (size == 0)
+    {
+        Free(original);
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        ++statistics_.scopes[allocationScope].reallocationCount;
+
+        // Shrinking, or growing into the slack of the size class, works
+        // in place
+        AllocationHeader* header = GetHeader(original);
+        if (GetCapacity(original) >= size &&
+            (reinterpret_cast<uintptr_t> (original) & (alignment - 1)) == 0)
+        {
+            statistics_.currentBytes -= header->size;
+            statistics_.currentBytes += size;
+            statistics_.peakBytes = std::max(statistics_.peakBytes,
+                statistics_.currentBytes);
+            header->size = size;
+
+            return original;
+        }
+    }
+
+    void* result = Allocate(size, alignment, allocationScope);
+
+    if (result)
+    {
+        const std::size_t originalSize =
+            static_cast<std::size_t> (GetHeader(original)->size);
+        std::memcpy(result, original, std::min(originalSize, size));
+        Free(original);
+    }
+
+    // On failure, the original allocation must stay valid
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void HostAllocator::Free(void* memory)
+{
+    if (!memory)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const AllocationHeader* header = GetHeader(memory);
+    uint8_t* base = static_cast<uint8_t*> (memory) - header->offset;
+
+    statistics_.currentBytes -= header->size;
+    ++statistics_.freeCount;
+
+    switch (header->sizeClass)
+    {
+    case AK_Linear:
+        assert(liveLinearAllocationCount_ > 0);
+        --liveLinearAllocationCount_;
+        break;
+
+    case AK_Large:
+        std::free(base);
+        break;
+
+    default:
+        *reinterpret_cast<void**> (base) = freeLists_[header->sizeClass];
+        freeLists_[header->sizeClass] = base;
+        break;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void* HostAllocator::AllocateLinear(const std::size_t size, const std::size_t alignment)
+{
+    if (!linearScope_)
+    {
+        return nullptr;
+    }
+
+    const std::size_t blockAlignment = std::max(alignment, MinAlignment);
+    uint8_t* base = AlignPointer(linearScope_ + linearScopeHead_, MinAlignment);
+    uint8_t* result = AlignPointer(base + sizeof(AllocationHeader), blockAlignment);
+
+    if (result + size > linearScope_ + linearScopeSize_)
+    {
+        ++statistics_.linearOverflowCount;
+        return nullptr;
+    }
+
+    PlaceAllocation(base, size, blockAlignment, AK_Linear);
+
+    linearScopeHead_ = (result + size) - linearScope_;
+    ++liveLinearAllocationCount_;
+    ++statistics_.linearAllocationCount;
+    statistics_.peakLinearBytes = std::max<uint64_t> (statistics_.peakLinearBytes,
+        linearScopeHead_);
+
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void* HostAllocator::AllocatePooled(const std::size_t size, const std::size_t alignment)
+{
+    const std::size_t blockAlignment = std::max(alignment, MinAlignment);
+    // Blocks are MinAlignment-aligned, so the header always fits into the
+    // alignment padding
+    const std::size_t blockSize = size + blockAlignment;
+
+    int sizeClass = 0;
+    while (sizeClass < SizeClassCount &&
+        (std::size_t(1) << (sizeClass + MinSizeClassShift)) < blockSize)
+    {
+        ++sizeClass;
+    }
+
+    if (sizeClass == SizeClassCount)
+    {
+        // malloc only guarantees 8 byte alignment on some platforms
+        uint8_t* base = static_cast<uint8_t*> (std::malloc(blockSize + MinAlignment));
+        if (!base)
+        {
+            return nullptr;
+        }
+
+        ++statistics_.systemAllocationCount;
+
+        return PlaceAllocation(base, size, blockAlignment, AK_Large);
+    }
+
+    uint8_t* block = static_cast<uint8_t*> (AllocateBlock(sizeClass));
+    if (!block)
+    {
+        return nullptr;
+    }
+
+    return PlaceAllocation(block, size, blockAlignment, sizeClass);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void* HostAllocator::AllocateBlock(const int sizeClass)
+{
+    if (freeLists_[sizeClass])
+    {
+        void* result = freeLists_[sizeClass];
+        freeLists_[sizeClass] = *static_cast<void**> (result);
+
+        ++statistics_.pooledAllocationCount;
+
+        return result;
+    }
+
+    // Carve a new chunk into blocks of this size class. The chunk belongs
+    // to the size class for good.
+    const std::size_t blockSize = std::size_t(1) << (sizeClass + MinSizeClassShift);
+
+    uint8_t* chunk = static_cast<uint8_t*> (std::malloc(ChunkSize + MinAlignment));
+    if (!chunk)
+    {
+        return nullptr;
+    }
+
+    chunks_.push_back(chunk);
+    ++statistics_.systemAllocationCount;
+    ++statistics_.chunkCount;
+
+    uint8_t* first = AlignPointer(chunk, MinAlignment);
+    const std::size_t blockCount = ChunkSize / blockSize;
+
+    // Keep the first block, put the others on the free list
+    for (std::size_t i = blockCount - 1; i > 0; --i)
+    {
+        void* block = first + i * blockSize;
+        *static_cast<void**> (block) = freeLists_[sizeClass];
+        freeLists_[sizeClass] = block;
+    }
+
+    return first;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+std::size_t HostAllocator::GetCapacity(void* memory) const
+{
+    const AllocationHeader* header = GetHeader(memory);
+
+    switch (header->sizeClass)
+    {
+    case AK_Linear:
+    case AK_Large:
+        // The exact size of these blocks is not known
+        return static_cast<std::size_t> (header->size);
+
+    default:
+        return (std::size_t(1) << (header->sizeClass + MinSizeClassShift))
+            - header->offset;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void* VKAPI_CALL HostAllocator::AllocationFunction(void* userData,
+    std::size_t size, std::size_t alignment,
+    VkSystemAllocationScope allocationScope)
+{
+    return static_cast<HostAllocator*> (userData)->Allocate(size, alignment,
+        allocationScope);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void* VKAPI_CALL HostAllocator::ReallocationFunction(void* userData,
+    void* original, std::size_t size, std::size_t alignment,
+    VkSystemAllocationScope allocationScope)
+{
+    return static_cast<HostAllocator*> (userData)->Reallocate(original, size,
+        alignment, allocationScope);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VKAPI_CALL HostAllocator::FreeFunction(void* userData, void* memory)
+{
+    static_cast<HostAllocator*> (userData)->Free(memory);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VKAPI_CALL HostAllocator::InternalAllocationNotification(void* userData,
+    std::size_t size, VkInternalAllocationType /*allocationType*/,
+    VkSystemAllocationScope /*allocationScope*/)
+{
+    HostAllocator* allocator = static_cast<HostAllocator*> (userData);
+
+    std::lock_guard<std::mutex> lock(allocator->mutex_);
+
+    auto& statistics = allocator->statistics_;
+    statistics.internalBytes += size;
+    statistics.peakInternalBytes = std::max(statistics.peakInternalBytes,
+        statistics.internalBytes);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VKAPI_CALL HostAllocator::InternalFreeNotification(void* userData,
+    std::size_t size, VkInternalAllocationType /*allocationType*/,
+    VkSystemAllocationScope /*allocationScope*/)
+{
+    HostAllocator* allocator = static_cast<HostAllocator*> (userData);
+
+    std::lock_guard<std::mutex> lock(allocator->mutex_);
+    allocator->statistics_.internalBytes -= size;
+}
+}   // namespace AMD
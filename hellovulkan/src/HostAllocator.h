@@ -0,0 +1,174 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_HOSTALLOCATOR_H_
+#define AMD_VULKAN_SAMPLE_HOSTALLOCATOR_H_
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Host memory use of the driver, as seen through VkAllocationCallbacks.
+*/
+struct HostAllocationStatistics
+{
+    struct Scope
+    {
+        uint64_t allocationCount = 0;
+        uint64_t reallocationCount = 0;
+    };
+
+    // Indexed by VkSystemAllocationScope
+    Scope scopes[VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1];
+    // Frees don't come with a scope
+    uint64_t freeCount = 0;
+
+    // Bytes requested by the driver and not freed yet, and the maximum
+    uint64_t currentBytes = 0;
+    uint64_t peakBytes = 0;
+
+    // Allocations served from a size class free list, without touching
+    // the system heap
+    uint64_t pooledAllocationCount = 0;
+    // Calls to the system heap: new pool chunks and large allocations.
+    // This is the number to keep flat while frames are running.
+    uint64_t systemAllocationCount = 0;
+    uint64_t chunkCount = 0;
+
+    // COMMAND scope allocations served by the linear scope, and those
+    // which did not fit and went to the pools instead
+    uint64_t linearAllocationCount = 0;
+    uint64_t linearOverflowCount = 0;
+    uint64_t peakLinearBytes = 0;
+
+    // Allocations the driver makes on its own and reports through the
+    // internal allocation notifications, for instance executable memory
+    uint64_t internalBytes = 0;
+    uint64_t peakInternalBytes = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Host allocator handed to Vulkan for all driver-side allocations.
+*
+* Small allocations - up to 4 KiB including alignment - come from size
+* class pools. Each size class is a free list of blocks carved from 64 KiB
+* chunks, which are never returned to the system until the allocator is
+* destroyed. Once the working set of the driver has been reached, the
+* steady state does not call malloc at all.
+*
+* VK_SYSTEM_ALLOCATION_SCOPE_COMMAND allocations only live for the
+* duration of a single Vulkan call, so they are bumped from a linear
+* buffer instead, which is recycled by BeginFrame().
+*
+* Thread-safe, Vulkan may call it from any thread which makes Vulkan calls.
+*/
+class HostAllocator
+{
+public:
+    HostAllocator(const HostAllocator&) = delete;
+    HostAllocator& operator= (const HostAllocator&) = delete;
+
+    explicit HostAllocator(const std::size_t linearScopeSize = 256 << 10);
+    ~HostAllocator();
+
+    /**
+    * Pass this to every vkCreate*, vkAllocate*, vkDestroy* and vkFree*
+    * call. Objects must be destroyed with the callbacks they were created
+    * with.
+    */
+    const VkAllocationCallbacks* GetCallbacks() const
+    {
+        return &callbacks_;
+    }
+
+    /**
+    * Recycle the linear scope. Call once per frame, while no Vulkan call
+    * is in progress on any thread. If a COMMAND scope allocation is
+    * still live, the scope is kept until the next frame.
+    */
+    void BeginFrame();
+
+    void GetStatistics(HostAllocationStatistics* outputStatistics) const;
+
+private:
+    static VKAPI_ATTR void* VKAPI_CALL AllocationFunction(void* userData,
+        std::size_t size, std::size_t alignment,
+        VkSystemAllocationScope allocationScope);
+    static VKAPI_ATTR void* VKAPI_CALL ReallocationFunction(void* userData,
+        void* original, std::size_t size, std::size_t alignment,
+        VkSystemAllocationScope allocationScope);
+    static VKAPI_ATTR void VKAPI_CALL FreeFunction(void* userData,
+        void* memory);
+    static VKAPI_ATTR void VKAPI_CALL InternalAllocationNotification(
+        void* userData, std::size_t size,
+        VkInternalAllocationType allocationType,
+        VkSystemAllocationScope allocationScope);
+    static VKAPI_ATTR void VKAPI_CALL InternalFreeNotification(
+        void* userData, std::size_t size,
+        VkInternalAllocationType allocationType,
+        VkSystemAllocationScope allocationScope);
+
+    void* Allocate(const std::size_t size, const std::size_t alignment,
+        const VkSystemAllocationScope allocationScope);
+    void* Reallocate(void* original, const std::size_t size,
+        const std::size_t alignment,
+        const VkSystemAllocationScope allocationScope);
+    void Free(void* memory);
+
+    void* AllocateLinear(const std::size_t size, const std::size_t alignment);
+    void* AllocatePooled(const std::size_t size, const std::size_t alignment);
+    void* AllocateBlock(const int sizeClass);
+    std::size_t GetCapacity(void* memory) const;
+
+    enum
+    {
+        // 32, 64, ... 4096 bytes
+        MinSizeClassShift = 5,
+        SizeClassCount = 8,
+        ChunkSize = 64 << 10
+    };
+
+    VkAllocationCallbacks callbacks_;
+
+    mutable std::mutex mutex_;
+
+    // Singly-linked through the first bytes of each free block
+    void* freeLists_[SizeClassCount];
+    // As returned by malloc, for freeing
+    std::vector<void*> chunks_;
+
+    uint8_t* linearScope_ = nullptr;
+    std::size_t linearScopeSize_ = 0;
+    std::size_t linearScopeHead_ = 0;
+    int liveLinearAllocationCount_ = 0;
+
+    HostAllocationStatistics statistics_;
+};
+}   // namespace AMD
+
+#endif
@@ -36,8 +36,8 @@ using namespace Microsoft::WRL;
 #undef LoadImage
 
 namespace {
-std::vector<std::uint8_t> LoadInternal(ComPtr<IWICImagingFactory> factory, ComPtr<IWICStream> stream,
-	const int rowAlignment, int* outputWidth, int* outputHeight)
+bool DecodeInternal(ComPtr<IWICImagingFactory> factory, ComPtr<IWICStream> stream,
+	const ImageDestinationFunction& getDestination, int* outputWidth, int* outputHeight)
 {
 	ComPtr<IWICBitmapDecoder> decoder;
 	factory->CreateDecoderFromStream(stream.Get(), nullptr,
@@ -56,13 +56,6 @@ std::vector<std::uint8_t> LoadInternal(ComPtr<IWICImagingFactory> factory, ComPt
 	UINT width, height;
 	converter->GetSize(&width, &height);
 
-	std::vector<std::uint8_t> result(
-		RoundToNextMultiple(width, static_cast<UINT> (rowAlignment)) * height * 4);
-
-	SAFE_WIC(converter->CopyPixels(nullptr,
-		RoundToNextMultiple(width, static_cast<UINT> (rowAlignment)) * 4,
-		static_cast<UINT> (result.size()), result.data()));
-
 	if (outputWidth) {
 		*outputWidth = static_cast<int> (width);
 	}
@@ -71,12 +64,37 @@ std::vector<std::uint8_t> LoadInternal(ComPtr<IWICImagingFactory> factory, ComPt
 		*outputHeight = static_cast<int> (height);
 	}
 
-	return result;
+	std::size_t rowPitch = width * 4;
+	void* destination = getDestination(static_cast<int> (width),
+		static_cast<int> (height), &rowPitch);
+
+	if (destination == nullptr) {
+		return false;
+	}
+
+	SAFE_WIC(converter->CopyPixels(nullptr,
+		static_cast<UINT> (rowPitch), static_cast<UINT> (rowPitch * height),
+		static_cast<BYTE*> (destination)));
+
+	return true;
 }
+
+std::vector<std::uint8_t> LoadInternal(ComPtr<IWICImagingFactory> factory, ComPtr<IWICStream> stream,
+	const int rowAlignment, int* outputWidth, int* outputHeight)
+{
+	std::vector<std::uint8_t> result;
+
+	DecodeInternal(factory, stream,
+		[&result, rowAlignment](const int width, const int height, std::size_t* rowPitch) -> void* {
+		*rowPitch = RoundToNextMultiple(width, rowAlignment) * 4;
+		result.resize(*rowPitch * height);
+		return result.data();
+	}, outputWidth, outputHeight);
+
+	return result;
 }
 
-std::vector<std::uint8_t> LoadImageFromFile (const char* path, const int rowAlignment,
-	int* outputWidth, int* outputHeight)
+ComPtr<IWICImagingFactory> CreateFactory()
 {
 	ComPtr<IWICImagingFactory> factory;
 	HRESULT hr = CoCreateInstance (
@@ -90,8 +108,11 @@ std::vector<std::uint8_t> LoadImageFromFile (const char* path, const int rowAlig
 		throw std::runtime_error ("Could not create WIC factory");
 	}
 
-	ComPtr<IWICBitmapDecoder> decoder;
+	return factory;
+}
 
+ComPtr<IWICStream> CreateFileStream(ComPtr<IWICImagingFactory> factory, const char* path)
+{
 	std::vector<wchar_t> pathWchar (::strlen (path) + 1);
 	mbstowcs (pathWchar.data (), path, pathWchar.size ());
 
@@ -99,25 +120,12 @@ std::vector<std::uint8_t> LoadImageFromFile (const char* path, const int rowAlig
 	factory->CreateStream(&stream);
 	stream->InitializeFromFilename(pathWchar.data (), GENERIC_READ);
 
-	return LoadInternal(factory, stream, rowAlignment, outputWidth, outputHeight);
-
+	return stream;
 }
 
-std::vector<std::uint8_t> LoadImageFromMemory(const void* data, const std::size_t size,  
-	const int rowAlignment, int* outputWidth, int* outputHeight)
+ComPtr<IWICStream> CreateMemoryStream(ComPtr<IWICImagingFactory> factory,
+	const void* data, const std::size_t size)
 {
-	ComPtr<IWICImagingFactory> factory;
-	HRESULT hr = CoCreateInstance(
-		CLSID_WICImagingFactory,
-		NULL,
-		CLSCTX_INPROC_SERVER,
-		IID_PPV_ARGS(&factory)
-		);
-
-	if (FAILED (hr)) {
-		throw std::runtime_error ("Could not create WIC factory");
-	}
-
 	ComPtr<IWICStream> stream;
 	factory->CreateStream(&stream);
 
@@ -125,5 +133,38 @@ std::vector<std::uint8_t> LoadImageFromMemory(const void* data, const std::size_
 	stream->InitializeFromMemory(static_cast<BYTE*> (const_cast<void*> (data)), 
 		static_cast<DWORD> (size));
 
-	return LoadInternal(factory, stream, rowAlignment, outputWidth, outputHeight);
+	return stream;
+}
+}
+
+std::vector<std::uint8_t> LoadImageFromFile (const char* path, const int rowAlignment,
+	int* outputWidth, int* outputHeight)
+{
+	auto factory = CreateFactory();
+	return LoadInternal(factory, CreateFileStream(factory, path), rowAlignment,
+		outputWidth, outputHeight);
+}
+
+std::vector<std::uint8_t> LoadImageFromMemory(const void* data, const std::size_t size,  
+	const int rowAlignment, int* outputWidth, int* outputHeight)
+{
+	auto factory = CreateFactory();
+	return LoadInternal(factory, CreateMemoryStream(factory, data, size), rowAlignment,
+		outputWidth, outputHeight);
+}
+
+bool DecodeImageFromFile (const char* path, const ImageDestinationFunction& getDestination,
+	int* outputWidth, int* outputHeight)
+{
+	auto factory = CreateFactory();
+	return DecodeInternal(factory, CreateFileStream(factory, path), getDestination,
+		outputWidth, outputHeight);
+}
+
+bool DecodeImageFromMemory(const void* data, const std::size_t size,
+	const ImageDestinationFunction& getDestination, int* outputWidth, int* outputHeight)
+{
+	auto factory = CreateFactory();
+	return DecodeInternal(factory, CreateMemoryStream(factory, data, size), getDestination,
+		outputWidth, outputHeight);
 }
@@ -25,6 +25,7 @@
 
 #include <vector>
 #include <cstdint>
+#include <functional>
 
 #ifdef LoadImage
 #undef LoadImage
@@ -36,4 +37,23 @@ std::vector<std::uint8_t> LoadImageFromFile (const char* path, const int rowAlig
 std::vector<std::uint8_t> LoadImageFromMemory(const void* data, const std::size_t size, const int rowAlignment,
 	int* width, int* height);
 
+/**
+* Called once the image size is known. Returns where to decode the RGBA8
+* pixels to - rowPitch bytes per row, at least width * 4, and rowPitch *
+* height bytes in total - or nullptr to skip decoding.
+*/
+typedef std::function<void* (const int width, const int height, std::size_t* rowPitch)>
+	ImageDestinationFunction;
+
+/**
+* Decode straight into memory provided by the caller, for instance a mapped
+* staging buffer, without an intermediate copy. Returns false if the
+* destination function returned nullptr.
+*/
+bool DecodeImageFromFile (const char* path, const ImageDestinationFunction& getDestination,
+	int* width, int* height);
+
+bool DecodeImageFromMemory(const void* data, const std::size_t size,
+	const ImageDestinationFunction& getDestination, int* width, int* height);
+
 #endif
\ No newline at end of file
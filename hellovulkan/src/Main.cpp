@@ -21,32 +21,558 @@
 //
 
 #include "VulkanQuad.h"
+
+#ifdef _WIN32
 #include "VulkanTexturedQuad.h"
+#include <Psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
 
-int WinMain(
-    _In_ HINSTANCE /* hInstance */,
-    _In_opt_ HINSTANCE /* hPrevInstance */,
-    _In_ LPSTR     /* lpCmdLine */,
-    _In_ int       /* nCmdShow */
-    )
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+///////////////////////////////////////////////////////////////////////////////
+struct BenchmarkOptions
+{
+    AMD::SampleOptions sampleOptions;
+
+    std::string sample = "quad";
+    int frameCount = 512;
+    // Frames which are rendered, but not included in the report
+    int warmupFrameCount = 0;
+    // "-" writes the report to stdout. The Windows build is a GUI
+    // application without one, so it writes to a file by default.
+#ifdef _WIN32
+    std::string reportFilename = "report.json";
+#else
+    std::string reportFilename = "-";
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////////////
+void PrintUsage()
+{
+    std::fprintf(stderr,
+        "Usage: HelloVulkan [options]\n"
+        "  --sample quad|texturedquad  Sample to run (default: quad)\n"
+        "  --frames N                  Number of measured frames (default: 512)\n"
+        "  --warmup N                  Frames to render before measuring (default: 0)\n"
+        "  --present-mode MODE         fifo, fifo-relaxed, mailbox or immediate\n"
+        "  --uncapped                  Don't wait for vertical blank\n"
+        "  --width N, --height N       Resolution (default: 1280x720)\n"
+        "  --headless                  Render offscreen, without a window\n"
+        "  --frames-in-flight N        Frames the CPU may run ahead (default: 3)\n"
+        "  --workers N                 Threads recording render tasks (default: 0)\n"
+        "  --record-once               Replay pre-recorded command buffers\n"
+        "  --depth                     Render with a depth buffer\n"
+        "  --no-host-allocator         Let the driver allocate host memory itself\n"
+        "  --no-transfer-queue         Upload on the graphics queue\n"
+        "  --defrag-budget MIB         Memory moved per frame to compact blocks, 0 disables (default: 16)\n"
+        "  --direct-upload-limit KIB   Largest upload written in place with resizable BAR, 0 disables (default: 1024)\n"
+#ifdef _WIN32
+        "  --report FILE               Write the JSON report to FILE, - for stdout (default: report.json)\n");
+#else
+        "  --report FILE               Write the JSON report to FILE (default: stdout)\n");
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+const struct
+{
+    const char* name;
+    VkPresentModeKHR presentMode;
+} PresentModeNames[] = {
+    { "fifo", VK_PRESENT_MODE_FIFO_KHR },
+    { "fifo-relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR },
+    { "mailbox", VK_PRESENT_MODE_MAILBOX_KHR },
+    { "immediate", VK_PRESENT_MODE_IMMEDIATE_KHR }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+bool ParsePresentMode(const char* name, VkPresentModeKHR* outputPresentMode)
+{
+    for (const auto& presentModeName : PresentModeNames)
+    {
+        if (std::strcmp(name, presentModeName.name) == 0)
+        {
+            *outputPresentMode = presentModeName.presentMode;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+const char* GetPresentModeName(const VkPresentModeKHR presentMode)
+{
+    for (const auto& presentModeName : PresentModeNames)
+    {
+        if (presentModeName.presentMode == presentMode)
+        {
+            return presentModeName.name;
+        }
+    }
+
+    return "unknown";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool ParseCommandLine(int argc, char* argv[], BenchmarkOptions* outputOptions)
+{
+    auto& options = *outputOptions;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+
+        // Options without a value
+        if (argument == "--headless")
+        {
+            options.sampleOptions.headless = true;
+            continue;
+        }
+        else if (argument == "--uncapped")
+        {
+            options.sampleOptions.uncapped = true;
+            continue;
+        }
+        else if (argument == "--record-once")
+        {
+            options.sampleOptions.recordOnce = true;
+            continue;
+        }
+        else if (argument == "--depth")
+        {
+            options.sampleOptions.depthBuffer = true;
+            continue;
+        }
+        else if (argument == "--no-host-allocator")
+        {
+            options.sampleOptions.hostAllocator = false;
+            continue;
+        }
+        else if (argument == "--no-transfer-queue")
+        {
+            options.sampleOptions.transferQueue = false;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            std::fprintf(stderr, "Missing value for '%s'\n", argv[i]);
+            return false;
+        }
+
+        const char* value = argv[++i];
+
+        if (argument == "--sample")
+        {
+            options.sample = value;
+        }
+        else if (argument == "--frames")
+        {
+            options.frameCount = std::atoi(value);
+        }
+        else if (argument == "--warmup")
+        {
+            options.warmupFrameCount = std::atoi(value);
+        }
+        else if (argument == "--present-mode")
+        {
+            if (!ParsePresentMode(value, &options.sampleOptions.presentMode))
+            {
+                std::fprintf(stderr, "Unknown present mode '%s'\n", value);
+                return false;
+            }
+        }
+        else if (argument == "--width")
+        {
+            options.sampleOptions.width = std::atoi(value);
+        }
+        else if (argument == "--height")
+        {
+            options.sampleOptions.height = std::atoi(value);
+        }
+        else if (argument == "--frames-in-flight")
+        {
+            options.sampleOptions.framesInFlight = std::atoi(value);
+        }
+        else if (argument == "--workers")
+        {
+            options.sampleOptions.workerThreadCount = std::atoi(value);
+        }
+        else if (argument == "--defrag-budget")
+        {
+            const int budget = std::atoi(value);
+
+            if (budget < 0)
+            {
+                std::fprintf(stderr, "Invalid option value\n");
+                return false;
+            }
+
+            options.sampleOptions.defragmentationBudget =
+                static_cast<VkDeviceSize> (budget) << 20;
+        }
+        else if (argument == "--direct-upload-limit")
+        {
+            const int limit = std::atoi(value);
+
+            if (limit < 0)
+            {
+                std::fprintf(stderr, "Invalid option value\n");
+                return false;
+            }
+
+            options.sampleOptions.directUploadLimit =
+                static_cast<VkDeviceSize> (limit) << 10;
+        }
+        else if (argument == "--report")
+        {
+            options.reportFilename = value;
+        }
+        else
+        {
+            std::fprintf(stderr, "Unknown option '%s'\n", argv[i - 1]);
+            return false;
+        }
+    }
+
+    if (options.frameCount <= 0 || options.warmupFrameCount < 0 ||
+        options.sampleOptions.width <= 0 || options.sampleOptions.height <= 0 ||
+        options.sampleOptions.framesInFlight <= 0 ||
+        options.sampleOptions.workerThreadCount < 0)
+    {
+        std::fprintf(stderr, "Invalid option value\n");
+        return false;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+std::size_t GetPeakMemoryUsage()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.PeakWorkingSetSize;
+    }
+
+    return 0;
+#else
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+
+    // ru_maxrss is in kilobytes on Linux
+    return static_cast<std::size_t> (usage.ru_maxrss) * 1024;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Write mean, percentiles and maximum of a series as a JSON object. The
+* percentiles use the nearest-rank method.
+*/
+void WriteStatistics(FILE* file, const char* name, std::vector<double> values,
+    const bool last)
+{
+    std::fprintf(file, "  \"%s\": ", name);
+
+    if (values.empty())
+    {
+        std::fprintf(file, "null%s\n", last ? "" : ",");
+        return;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    double sum = 0;
+    for (const auto value : values)
+    {
+        sum += value;
+    }
+
+    const auto percentile = [&values](const int p) {
+        const auto rank = (values.size() * p + 99) / 100;
+        return values[std::max<std::size_t>(rank, 1) - 1];
+    };
+
+    std::fprintf(file, "{ \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, "
+        "\"p99\": %.4f, \"max\": %.4f, \"count\": %d }%s\n",
+        sum / values.size(), percentile(50), percentile(95), percentile(99),
+        values.back(), static_cast<int> (values.size()), last ? "" : ",");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void WriteMemoryStatisticsEntry(FILE* file, const AMD::DeviceMemoryStatistics::Entry& entry)
+{
+    std::fprintf(file, "\"blockCount\": %d, \"dedicatedBlockCount\": %d, "
+        "\"blockBytes\": %llu, \"peakBlockBytes\": %llu, \"allocationCount\": %d, "
+        "\"usedBytes\": %llu, \"freeBytes\": %llu, \"fragmentation\": %.4f",
+        entry.blockCount, entry.dedicatedBlockCount,
+        static_cast<unsigned long long> (entry.blockBytes),
+        static_cast<unsigned long long> (entry.peakBlockBytes),
+        entry.allocationCount,
+        static_cast<unsigned long long> (entry.usedBytes),
+        static_cast<unsigned long long> (entry.freeBytes),
+        entry.GetFragmentation());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void WriteMemoryStatistics(FILE* file, const AMD::DeviceMemoryStatistics& statistics)
+{
+    std::fprintf(file, "  \"deviceMemory\": {\n");
+    std::fprintf(file, "    \"budgetAvailable\": %s,\n",
+        statistics.budgetAvailable ? "true" : "false");
+    std::fprintf(file, "    \"total\": { ");
+    WriteMemoryStatisticsEntry(file, statistics.total);
+    std::fprintf(file, " },\n");
+
+    std::fprintf(file, "    \"heaps\": [");
+    for (int i = 0; i < statistics.heapCount; ++i)
+    {
+        std::fprintf(file, "%s\n      { \"budget\": %llu, \"usage\": %llu, ",
+            i == 0 ? "" : ",",
+            static_cast<unsigned long long> (statistics.heapBudget[i]),
+            static_cast<unsigned long long> (statistics.heapUsage[i]));
+        WriteMemoryStatisticsEntry(file, statistics.heaps[i]);
+        std::fprintf(file, " }");
+    }
+    std::fprintf(file, "\n    ],\n");
+
+    std::fprintf(file, "    \"memoryTypes\": [");
+    for (int i = 0; i < statistics.memoryTypeCount; ++i)
+    {
+        std::fprintf(file, "%s\n      { ", i == 0 ? "" : ",");
+        WriteMemoryStatisticsEntry(file, statistics.memoryTypes[i]);
+        std::fprintf(file, " }");
+    }
+    std::fprintf(file, "\n    ]\n");
+    std::fprintf(file, "  },\n");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void WriteHostMemoryStatistics(FILE* file, const AMD::HostAllocationStatistics& statistics)
+{
+    static const char* scopeNames[] = {
+        "command", "object", "cache", "device", "instance"
+    };
+
+    std::fprintf(file, "  \"hostMemory\": {\n");
+    std::fprintf(file, "    \"currentBytes\": %llu, \"peakBytes\": %llu,\n",
+        static_cast<unsigned long long> (statistics.currentBytes),
+        static_cast<unsigned long long> (statistics.peakBytes));
+    std::fprintf(file, "    \"pooledAllocationCount\": %llu, \"systemAllocationCount\": %llu, "
+        "\"chunkCount\": %llu, \"freeCount\": %llu,\n",
+        static_cast<unsigned long long> (statistics.pooledAllocationCount),
+        static_cast<unsigned long long> (statistics.systemAllocationCount),
+        static_cast<unsigned long long> (statistics.chunkCount),
+        static_cast<unsigned long long> (statistics.freeCount));
+    std::fprintf(file, "    \"linearAllocationCount\": %llu, \"linearOverflowCount\": %llu, "
+        "\"peakLinearBytes\": %llu,\n",
+        static_cast<unsigned long long> (statistics.linearAllocationCount),
+        static_cast<unsigned long long> (statistics.linearOverflowCount),
+        static_cast<unsigned long long> (statistics.peakLinearBytes));
+    std::fprintf(file, "    \"internalBytes\": %llu, \"peakInternalBytes\": %llu,\n",
+        static_cast<unsigned long long> (statistics.internalBytes),
+        static_cast<unsigned long long> (statistics.peakInternalBytes));
+
+    std::fprintf(file, "    \"scopes\": {");
+    for (int i = 0; i <= VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE; ++i)
+    {
+        std::fprintf(file, "%s\n      \"%s\": { \"allocationCount\": %llu, "
+            "\"reallocationCount\": %llu }",
+            i == 0 ? "" : ",", scopeNames[i],
+            static_cast<unsigned long long> (statistics.scopes[i].allocationCount),
+            static_cast<unsigned long long> (statistics.scopes[i].reallocationCount));
+    }
+    std::fprintf(file, "\n    }\n");
+    std::fprintf(file, "  },\n");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool WriteReport(const BenchmarkOptions& options, const AMD::VulkanSample& sample)
 {
+    FILE* file = stdout;
+
+    if (options.reportFilename != "-")
+    {
+        file = std::fopen(options.reportFilename.c_str(), "w");
+
+        if (file == nullptr)
+        {
+            std::fprintf(stderr, "Could not open '%s'\n", options.reportFilename.c_str());
+            return false;
+        }
+    }
+
+    // Warmup frames are the first ones rendered, skip them by frame value
+    const auto& cpuFrameTimings = sample.GetCpuFrameTimings();
+    uint64_t firstMeasuredFrame = 0;
+
+    if (static_cast<int> (cpuFrameTimings.size()) > options.warmupFrameCount)
+    {
+        firstMeasuredFrame = cpuFrameTimings[options.warmupFrameCount].frame;
+    }
+
+    std::vector<double> cpuFrameTimes, cpuRecordTimes, gpuFrameTimes, gpuRenderTimes;
+
+    for (const auto& timing : cpuFrameTimings)
+    {
+        if (timing.frame >= firstMeasuredFrame)
+        {
+            cpuFrameTimes.push_back(timing.frameTime);
+            cpuRecordTimes.push_back(timing.recordTime);
+        }
+    }
+
+    for (const auto& timing : sample.GetGpuFrameTimings())
+    {
+        if (timing.frame >= firstMeasuredFrame)
+        {
+            gpuFrameTimes.push_back(timing.frameTime);
+            gpuRenderTimes.push_back(timing.renderTime);
+        }
+    }
+
+    const auto& sampleOptions = options.sampleOptions;
+
+    std::fprintf(file, "{\n");
+    std::fprintf(file, "  \"sample\": \"%s\",\n", options.sample.c_str());
+    std::fprintf(file, "  \"frames\": %d,\n", options.frameCount);
+    std::fprintf(file, "  \"warmupFrames\": %d,\n", options.warmupFrameCount);
+    std::fprintf(file, "  \"width\": %d,\n", sampleOptions.width);
+    std::fprintf(file, "  \"height\": %d,\n", sampleOptions.height);
+    std::fprintf(file, "  \"headless\": %s,\n", sampleOptions.headless ? "true" : "false");
+    // The mode actually used, after --uncapped and fallbacks
+    std::fprintf(file, "  \"presentMode\": \"%s\",\n", sampleOptions.headless
+        ? "none" : GetPresentModeName(sample.GetPresentMode()));
+    std::fprintf(file, "  \"uncapped\": %s,\n", sampleOptions.uncapped ? "true" : "false");
+    std::fprintf(file, "  \"framesInFlight\": %d,\n", sampleOptions.framesInFlight);
+    std::fprintf(file, "  \"workers\": %d,\n", sampleOptions.workerThreadCount);
+    std::fprintf(file, "  \"recordOnce\": %s,\n", sampleOptions.recordOnce ? "true" : "false");
+    std::fprintf(file, "  \"depthBuffer\": %s,\n", sample.HasDepthBuffer() ? "true" : "false");
+    std::fprintf(file, "  \"hostAllocator\": %s,\n", sampleOptions.hostAllocator ? "true" : "false");
+    std::fprintf(file, "  \"transferQueue\": %s,\n", sampleOptions.transferQueue ? "true" : "false");
+    // 0 if the device has no resizable BAR
+    std::fprintf(file, "  \"directUploadLimitBytes\": %llu,\n",
+        static_cast<unsigned long long> (sample.GetDirectUploadLimit()));
+
+    std::fprintf(file, "  \"startup\": {");
+    const auto& startupTimings = sample.GetStartupTimings();
+    for (std::size_t i = 0; i < startupTimings.size(); ++i)
+    {
+        std::fprintf(file, "%s\n    \"%s\": %.4f", i == 0 ? "" : ",",
+            startupTimings[i].name, startupTimings[i].time);
+    }
+    std::fprintf(file, "\n  },\n");
+
+    std::fprintf(file, "  \"peakMemoryBytes\": %llu,\n",
+        static_cast<unsigned long long> (GetPeakMemoryUsage()));
+
+    WriteMemoryStatistics(file, sample.GetMemoryStatistics());
+    WriteHostMemoryStatistics(file, sample.GetHostAllocationStatistics());
+
+    const auto& defragmentationStatistics = sample.GetDefragmentationStatistics();
+    std::fprintf(file, "  \"defragmentation\": { \"budgetBytes\": %llu, "
+        "\"evacuatedBlockCount\": %d, \"abortedPassCount\": %d, "
+        "\"moveCount\": %d, \"movedBytes\": %llu },\n",
+        static_cast<unsigned long long> (sampleOptions.defragmentationBudget),
+        defragmentationStatistics.evacuatedBlockCount,
+        defragmentationStatistics.abortedPassCount,
+        defragmentationStatistics.moveCount,
+        static_cast<unsigned long long> (defragmentationStatistics.movedBytes));
+
+    // All times are in milliseconds
+    WriteStatistics(file, "cpuFrameTime", cpuFrameTimes, false);
+    WriteStatistics(file, "cpuRecordTime", cpuRecordTimes, false);
+    WriteStatistics(file, "gpuFrameTime", gpuFrameTimes, false);
+    WriteStatistics(file, "gpuRenderTime", gpuRenderTimes, true);
+    std::fprintf(file, "}\n");
+
+    if (file != stdout)
+    {
+        std::fclose(file);
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int RunBenchmark(int argc, char* argv[], const bool defaultHeadless)
+{
+    BenchmarkOptions options;
+    options.sampleOptions.headless = defaultHeadless;
+
+    if (!ParseCommandLine(argc, argv, &options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
     AMD::VulkanSample* sample = nullptr;
 
-    const auto sampleId = 0;
+    if (options.sample == "quad")
+    {
+        sample = new AMD::VulkanQuad{ options.sampleOptions };
+    }
+#ifdef _WIN32
+    else if (options.sample == "texturedquad")
+    {
+        sample = new AMD::VulkanTexturedQuad{ options.sampleOptions };
+    }
+#endif
+    else
+    {
+        std::fprintf(stderr, "Unknown sample '%s'\n", options.sample.c_str());
+        PrintUsage();
+        return 1;
+    }
 
-    switch (sampleId)
+    if (sample->IsInitialized() == false)
     {
-    case 0: sample = new AMD::VulkanQuad; break;
-    case 1: sample = new AMD::VulkanTexturedQuad; break;
+        delete sample;
+        return 1;
     }
 
-    if (sample == nullptr || sample->IsInitialized() == false)
+    if (!sample->Run(options.warmupFrameCount + options.frameCount))
     {
+        delete sample;
         return 1;
     }
 
-    sample->Run(512);
+    const bool reportWritten = WriteReport(options, *sample);
     delete sample;
 
-    return 0;
+    return reportWritten ? 0 : 1;
+}
+}   // namespace
+
+#ifdef _WIN32
+int WinMain(
+    _In_ HINSTANCE /* hInstance */,
+    _In_opt_ HINSTANCE /* hPrevInstance */,
+    _In_ LPSTR     /* lpCmdLine */,
+    _In_ int       /* nCmdShow */
+    )
+{
+    return RunBenchmark(__argc, __argv, false);
+}
+#else
+int main(int argc, char* argv[])
+{
+    // There is no window support on this platform, render offscreen
+    return RunBenchmark(argc, argv, true);
 }
+#endif
@@ -0,0 +1,351 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "StagingRing.h"
+
+#include "FrameScheduler.h"
+#include "Utility.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+StagingRing::StagingRing(VkPhysicalDevice physicalDevice, VkDevice device,
+    DeviceMemoryAllocator& allocator, const FrameScheduler& frameScheduler,
+    const VkDeviceSize size, const VkAllocationCallbacks* allocationCallbacks,
+    const std::vector<uint32_t>& queueFamilyIndices)
+    : device_(device)
+    , allocationCallbacks_(allocationCallbacks)
+    , allocator_(allocator)
+    , frameScheduler_(frameScheduler)
+    , queueFamilyIndices_(queueFamilyIndices)
+    , size_(size)
+{
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+    // Buffer to image copies need at least texel alignment, 16 covers all
+    // formats we upload
+    minAlignment_ = std::max<VkDeviceSize>(16,
+        physicalDeviceProperties.limits.optimalBufferCopyOffsetAlignment);
+
+    const bool created = CreateBuffer(size_, &buffer_, &memory_);
+    assert(created);
+    (void)created;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+StagingRing::~StagingRing()
+{
+    for (auto& overflowBuffer : overflowBuffers_)
+    {
+        vkDestroyBuffer(device_, overflowBuffer.buffer, allocationCallbacks_);
+        allocator_.Free(overflowBuffer.memory);
+    }
+
+    vkDestroyBuffer(device_, buffer_, allocationCallbacks_);
+    allocator_.Free(memory_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool StagingRing::Allocate(const VkDeviceSize size, const VkDeviceSize alignment,
+    StagingRegion* outputRegion)
+{
+    assert(outputRegion);
+
+    if (size > size_)
+    {
+        return AllocateOverflow(size, outputRegion);
+    }
+
+    const VkDeviceSize regionAlignment = std::max(alignment, minAlignment_);
+
+    for (;;)
+    {
+        Reclaim();
+
+        if (usedSize_ == 0)
+        {
+            head_ = tail_ = 0;
+        }
+
+        // If the head is behind the tail, the free space is the gap
+        // between them. Otherwise, it's the rest of the buffer, and if that
+        // is too small, the start of the buffer up to the tail.
+        const VkDeviceSize offset = RoundToNextMultiple(head_, regionAlignment);
+        VkDeviceSize regionOffset = size_;
+
+        if (head_ < tail_ || (head_ == tail_ && usedSize_ > 0))
+        {
+            if (offset + size <= tail_)
+            {
+                regionOffset = offset;
+            }
+        }
+        else if (offset + size <= size_)
+        {
+            regionOffset = offset;
+        }
+        else if (size <= tail_)
+        {
+            regionOffset = 0;
+        }
+
+        if (regionOffset != size_)
+        {
+            // Includes the alignment padding and the skipped end of the
+            // buffer if we wrapped around
+            const VkDeviceSize consumed = (regionOffset >= head_)
+                ? (regionOffset + size - head_)
+                : (size_ - head_ + regionOffset + size);
+
+            head_ = regionOffset + size;
+            usedSize_ += consumed;
+            unsubmittedSize_ += consumed;
+
+            StagingRegion region;
+            region.buffer = buffer_;
+            region.offset = regionOffset;
+            region.size = size;
+            region.mappedData = static_cast<uint8_t*> (memory_.mappedData) + regionOffset;
+
+            *outputRegion = region;
+            return true;
+        }
+
+        if (pendingFrames_.empty() || pendingFrames_.front().held)
+        {
+            // Everything is in use by the frame being recorded, or behind
+            // held regions, waiting won't free anything
+            return AllocateOverflow(size, outputRegion);
+        }
+
+        frameScheduler_.WaitForFrame(pendingFrames_.front().frame);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void StagingRing::MarkDirty(const StagingRegion& region)
+{
+    if (region.buffer == buffer_)
+    {
+        allocator_.MarkDirty(memory_, region.offset, region.size);
+        return;
+    }
+
+    for (const auto& overflowBuffer : overflowBuffers_)
+    {
+        if (overflowBuffer.buffer == region.buffer)
+        {
+            allocator_.MarkDirty(overflowBuffer.memory, region.offset, region.size);
+            return;
+        }
+    }
+
+    assert(false);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void StagingRing::Submit(const uint64_t frame)
+{
+    // Releases retired overflow buffers even if nothing is allocated for
+    // a while
+    Reclaim();
+
+    for (auto& overflowBuffer : overflowBuffers_)
+    {
+        if (!overflowBuffer.submitted)
+        {
+            overflowBuffer.frame = frame;
+            overflowBuffer.submitted = true;
+        }
+    }
+
+    if (unsubmittedSize_ == 0)
+    {
+        return;
+    }
+
+    PendingFrame pendingFrame;
+    pendingFrame.frame = frame;
+    pendingFrame.end = head_;
+    pendingFrame.usedSize = unsubmittedSize_;
+    pendingFrame.held = false;
+
+    pendingFrames_.push_back(pendingFrame);
+    unsubmittedSize_ = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void StagingRing::Hold()
+{
+    for (auto& overflowBuffer : overflowBuffers_)
+    {
+        if (!overflowBuffer.submitted)
+        {
+            overflowBuffer.submitted = true;
+            overflowBuffer.held = true;
+        }
+    }
+
+    if (unsubmittedSize_ == 0)
+    {
+        return;
+    }
+
+    PendingFrame pendingFrame;
+    pendingFrame.frame = 0;
+    pendingFrame.end = head_;
+    pendingFrame.usedSize = unsubmittedSize_;
+    pendingFrame.held = true;
+
+    pendingFrames_.push_back(pendingFrame);
+    unsubmittedSize_ = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void StagingRing::Release(const uint64_t frame)
+{
+    for (auto& overflowBuffer : overflowBuffers_)
+    {
+        if (overflowBuffer.held)
+        {
+            overflowBuffer.frame = frame;
+            overflowBuffer.held = false;
+        }
+    }
+
+    // Frames submitted since Hold() are queued behind these, the ring is
+    // reclaimed in order
+    for (auto& pendingFrame : pendingFrames_)
+    {
+        if (pendingFrame.held)
+        {
+            pendingFrame.frame = frame;
+            pendingFrame.held = false;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void StagingRing::Reclaim()
+{
+    while (!pendingFrames_.empty() && !pendingFrames_.front().held &&
+        frameScheduler_.IsFrameRetired(pendingFrames_.front().frame))
+    {
+        tail_ = pendingFrames_.front().end;
+        usedSize_ -= pendingFrames_.front().usedSize;
+        pendingFrames_.pop_front();
+    }
+
+    for (std::size_t i = 0; i < overflowBuffers_.size(); )
+    {
+        OverflowBuffer& overflowBuffer = overflowBuffers_[i];
+
+        if (overflowBuffer.submitted && !overflowBuffer.held &&
+            frameScheduler_.IsFrameRetired(overflowBuffer.frame))
+        {
+            vkDestroyBuffer(device_, overflowBuffer.buffer, allocationCallbacks_);
+            allocator_.Free(overflowBuffer.memory);
+
+            overflowBuffers_.erase(overflowBuffers_.begin() + i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool StagingRing::CreateBuffer(const VkDeviceSize size, VkBuffer* outputBuffer,
+    DeviceMemoryAllocation* outputMemory)
+{
+    VkBufferCreateInfo bufferCreateInfo = {};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.size = size;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    if (queueFamilyIndices_.size() > 1)
+    {
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferCreateInfo.queueFamilyIndexCount = static_cast<uint32_t> (queueFamilyIndices_.size());
+        bufferCreateInfo.pQueueFamilyIndices = queueFamilyIndices_.data();
+    }
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    if (vkCreateBuffer(device_, &bufferCreateInfo, allocationCallbacks_, &buffer) != VK_SUCCESS)
+    {
+        return false;
+    }
+
+    VkMemoryRequirements memoryRequirements = {};
+    vkGetBufferMemoryRequirements(device_, buffer, &memoryRequirements);
+
+    DeviceMemoryAllocation memory;
+    if (!allocator_.Allocate(memoryRequirements, MU_CpuToGpu, DMRT_Linear,
+        &memory))
+    {
+        vkDestroyBuffer(device_, buffer, allocationCallbacks_);
+        return false;
+    }
+
+    assert(memory.mappedData);
+
+    vkBindBufferMemory(device_, buffer, memory.memory, memory.offset);
+
+    *outputBuffer = buffer;
+    *outputMemory = memory;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool StagingRing::AllocateOverflow(const VkDeviceSize size,
+    StagingRegion* outputRegion)
+{
+    OverflowBuffer overflowBuffer;
+    overflowBuffer.frame = 0;
+    overflowBuffer.submitted = false;
+    overflowBuffer.held = false;
+
+    if (!CreateBuffer(size, &overflowBuffer.buffer, &overflowBuffer.memory))
+    {
+        DebugPrint("Could not create a %llu byte staging buffer\n",
+            static_cast<unsigned long long> (size));
+        return false;
+    }
+
+    overflowBuffers_.push_back(overflowBuffer);
+
+    StagingRegion region;
+    region.buffer = overflowBuffer.buffer;
+    region.offset = 0;
+    region.size = size;
+    region.mappedData = overflowBuffer.memory.mappedData;
+
+    *outputRegion = region;
+    return true;
+}
+}   // namespace AMD
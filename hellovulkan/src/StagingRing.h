@@ -0,0 +1,170 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_STAGINGRING_H_
+#define AMD_VULKAN_SAMPLE_STAGINGRING_H_
+
+#include "DeviceMemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <vector>
+
+namespace AMD
+{
+class FrameScheduler;
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* A range of the staging ring. Write the upload data to mappedData, then
+* copy from buffer at offset.
+*/
+struct StagingRegion
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mappedData = nullptr;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* One persistently mapped upload buffer of fixed size, handed out as a ring.
+*
+* Regions allocated between two calls to Submit() belong to the frame
+* passed to Submit(), and are reclaimed once the frame scheduler reports
+* that frame as retired. If the ring is full, Allocate() waits for the
+* oldest frame which still holds regions. This bounds staging memory to
+* the size of the ring, no matter how much data goes through it.
+*
+* Requests which can't be served by waiting - larger than the ring, or
+* with all of it taken by regions which have not been submitted yet - get
+* a buffer of their own instead, which is released like a region once its
+* frame retires. Size the ring so this stays the exception.
+*
+* Regions read by work no frame waits for yet, like uploads on another
+* queue, are put aside with Hold() and handed to a frame with Release().
+* Until then they keep the space behind them in use as well.
+*
+* Not thread-safe, use it from the thread which submits frames.
+*/
+class StagingRing
+{
+public:
+    StagingRing(const StagingRing&) = delete;
+    StagingRing& operator= (const StagingRing&) = delete;
+
+    /**
+    * queueFamilyIndices are the families which copy from the ring. With
+    * more than one, the buffer is shared concurrently - it only ever
+    * holds data fresh from the host, so ownership transfers would buy
+    * nothing.
+    */
+    StagingRing(VkPhysicalDevice physicalDevice, VkDevice device,
+        DeviceMemoryAllocator& allocator, const FrameScheduler& frameScheduler,
+        const VkDeviceSize size,
+        const VkAllocationCallbacks* allocationCallbacks = nullptr,
+        const std::vector<uint32_t>& queueFamilyIndices = std::vector<uint32_t>());
+    ~StagingRing();
+
+    /**
+    * May wait for a frame to retire. Returns false only if the ring is out
+    * of space and a separate buffer for the request could not be created
+    * either, outputRegion is left alone in that case.
+    */
+    bool Allocate(const VkDeviceSize size, const VkDeviceSize alignment,
+        StagingRegion* outputRegion);
+
+    /**
+    * Record that the region was written. The write becomes visible to the
+    * device with the next DeviceMemoryAllocator::FlushDirtyRanges().
+    */
+    void MarkDirty(const StagingRegion& region);
+
+    /**
+    * All regions allocated since the last call are consumed by frame.
+    */
+    void Submit(const uint64_t frame);
+
+    /**
+    * Like Submit(), but the regions stay in use until Release().
+    */
+    void Hold();
+
+    /**
+    * All regions passed to Hold() are consumed by frame.
+    */
+    void Release(const uint64_t frame);
+
+    VkDeviceSize GetSize() const
+    {
+        return size_;
+    }
+
+private:
+    bool CreateBuffer(const VkDeviceSize size, VkBuffer* outputBuffer,
+        DeviceMemoryAllocation* outputMemory);
+    bool AllocateOverflow(const VkDeviceSize size, StagingRegion* outputRegion);
+    void Reclaim();
+
+    struct PendingFrame
+    {
+        uint64_t frame;
+        // Where the ring tail moves once the frame retires
+        VkDeviceSize end;
+        VkDeviceSize usedSize;
+        // Not tied to a frame yet, see Hold()
+        bool held;
+    };
+
+    // Separate buffer for a request the ring couldn't take
+    struct OverflowBuffer
+    {
+        VkBuffer buffer;
+        DeviceMemoryAllocation memory;
+        uint64_t frame;
+        bool submitted;
+        bool held;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    const VkAllocationCallbacks* allocationCallbacks_ = nullptr;
+    DeviceMemoryAllocator& allocator_;
+    const FrameScheduler& frameScheduler_;
+    std::vector<uint32_t> queueFamilyIndices_;
+
+    VkBuffer buffer_ = VK_NULL_HANDLE;
+    DeviceMemoryAllocation memory_;
+    VkDeviceSize size_ = 0;
+    VkDeviceSize minAlignment_ = 1;
+
+    VkDeviceSize head_ = 0;
+    VkDeviceSize tail_ = 0;
+    VkDeviceSize usedSize_ = 0;
+    VkDeviceSize unsubmittedSize_ = 0;
+
+    std::deque<PendingFrame> pendingFrames_;
+    std::vector<OverflowBuffer> overflowBuffers_;
+};
+}   // namespace AMD
+
+#endif
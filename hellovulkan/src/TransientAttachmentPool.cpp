@@ -0,0 +1,228 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "TransientAttachmentPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+TransientAttachmentPool::TransientAttachmentPool(VkDevice device,
+    DeviceMemoryAllocator& allocator,
+    const DeviceMemoryProperties& memoryProperties,
+    const VkAllocationCallbacks* allocationCallbacks)
+    : device_(device)
+    , allocationCallbacks_(allocationCallbacks)
+    , allocator_(allocator)
+    , memoryProperties_(memoryProperties)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+TransientAttachmentPool::~TransientAttachmentPool()
+{
+    Clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int TransientAttachmentPool::Add(const TransientAttachmentDesc& desc)
+{
+    assert(!committed_);
+    // TRANSIENT_ATTACHMENT may only be combined with attachment usages
+    assert((desc.usage & ~(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+        | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+        | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT)) == 0);
+
+    Attachment attachment;
+    attachment.desc = desc;
+
+    VkImageCreateInfo imageCreateInfo = {};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = desc.format;
+    imageCreateInfo.extent.width = desc.extent.width;
+    imageCreateInfo.extent.height = desc.extent.height;
+    imageCreateInfo.extent.depth = 1;
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = desc.samples;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage = desc.usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    vkCreateImage(device_, &imageCreateInfo, allocationCallbacks_,
+        &attachment.image);
+
+    attachments_.push_back(attachment);
+
+    return static_cast<int> (attachments_.size()) - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool TransientAttachmentPool::Commit()
+{
+    assert(!committed_);
+    committed_ = true;
+
+    // Combined requirements of each alias group: large and aligned enough
+    // for every member, in a memory type all of them can use
+    std::map<int, VkMemoryRequirements> groupRequirements;
+
+    for (auto& attachment : attachments_)
+    {
+        VkImageMemoryRequirementsInfo2 requirementsInfo = {};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.image = attachment.image;
+
+        VkMemoryDedicatedRequirements dedicatedRequirements = {};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+        VkMemoryRequirements2 requirements = {};
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements.pNext = &dedicatedRequirements;
+
+        vkGetImageMemoryRequirements2(device_, &requirementsInfo, &requirements);
+
+        const VkMemoryRequirements& memoryRequirements =
+            requirements.memoryRequirements;
+
+        attachment.lazilyAllocated = memoryProperties_.FindMemoryType(
+            memoryRequirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, 0, 0) != -1;
+
+        // Nothing to gain from aliasing memory which is not backed, and
+        // an image which requires its own allocation cannot share it
+        if (attachment.lazilyAllocated || attachment.desc.aliasGroup < 0 ||
+            dedicatedRequirements.requiresDedicatedAllocation)
+        {
+            DeviceMemoryAllocation allocation;
+            if (!allocator_.AllocateForImage(attachment.image,
+                attachment.lazilyAllocated ? MU_TransientAttachment : MU_GpuOnly,
+                &allocation))
+            {
+                return false;
+            }
+
+            attachment.allocation = static_cast<int> (allocations_.size());
+            allocations_.push_back(allocation);
+
+            // The allocator may still have picked another type if the
+            // lazily allocated heap is full
+            attachment.lazilyAllocated =
+                (memoryProperties_.GetPropertyFlags(allocation.memoryTypeIndex)
+                & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+
+            if (!attachment.lazilyAllocated)
+            {
+                committedSize_ += allocation.size;
+            }
+
+            continue;
+        }
+
+        auto it = groupRequirements.find(attachment.desc.aliasGroup);
+        if (it == groupRequirements.end())
+        {
+            groupRequirements[attachment.desc.aliasGroup] = memoryRequirements;
+        }
+        else
+        {
+            it->second.size = std::max(it->second.size, memoryRequirements.size);
+            it->second.alignment = std::max(it->second.alignment,
+                memoryRequirements.alignment);
+            it->second.memoryTypeBits &= memoryRequirements.memoryTypeBits;
+        }
+    }
+
+    std::map<int, int> groupAllocations;
+
+    for (const auto& group : groupRequirements)
+    {
+        // If the members have no memory type in common, the group can't
+        // be aliased - which the caller has to fix by splitting it
+        assert(group.second.memoryTypeBits != 0);
+
+        DeviceMemoryAllocation allocation;
+        if (!allocator_.Allocate(group.second, MU_GpuOnly, DMRT_Optimal,
+            &allocation))
+        {
+            return false;
+        }
+
+        groupAllocations[group.first] = static_cast<int> (allocations_.size());
+        allocations_.push_back(allocation);
+        committedSize_ += allocation.size;
+    }
+
+    for (auto& attachment : attachments_)
+    {
+        if (attachment.allocation == -1)
+        {
+            attachment.allocation = groupAllocations[attachment.desc.aliasGroup];
+        }
+
+        const DeviceMemoryAllocation& allocation =
+            allocations_[attachment.allocation];
+
+        vkBindImageMemory(device_, attachment.image, allocation.memory,
+            allocation.offset);
+
+        VkImageViewCreateInfo imageViewCreateInfo = {};
+        imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        imageViewCreateInfo.image = attachment.image;
+        imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        imageViewCreateInfo.format = attachment.desc.format;
+        imageViewCreateInfo.subresourceRange.levelCount = 1;
+        imageViewCreateInfo.subresourceRange.layerCount = 1;
+        imageViewCreateInfo.subresourceRange.aspectMask = attachment.desc.aspect;
+
+        vkCreateImageView(device_, &imageViewCreateInfo, allocationCallbacks_,
+            &attachment.view);
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void TransientAttachmentPool::Clear()
+{
+    for (const auto& attachment : attachments_)
+    {
+        vkDestroyImageView(device_, attachment.view, allocationCallbacks_);
+        vkDestroyImage(device_, attachment.image, allocationCallbacks_);
+    }
+
+    for (auto& allocation : allocations_)
+    {
+        allocator_.Free(allocation);
+    }
+
+    attachments_.clear();
+    allocations_.clear();
+    committedSize_ = 0;
+    committed_ = false;
+}
+}   // namespace AMD
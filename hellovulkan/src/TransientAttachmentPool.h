@@ -0,0 +1,151 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_TRANSIENTATTACHMENTPOOL_H_
+#define AMD_VULKAN_SAMPLE_TRANSIENTATTACHMENTPOOL_H_
+
+#include "DeviceMemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+/**
+* An attachment which is only read and written inside a render pass: depth
+* buffers, multisampled color which gets resolved, intermediate targets
+* consumed as input attachments. Its contents must be cleared or
+* overwritten on load and discarded on store.
+*/
+struct TransientAttachmentDesc
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {};
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    // Attachment usages only, TRANSIENT_ATTACHMENT is added
+    VkImageUsageFlags usage = 0;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+    /**
+    * Attachments with the same alias group share memory if there is no
+    * lazily allocated memory. Only group attachments which are never live
+    * at the same time, -1 never aliases.
+    */
+    int aliasGroup = -1;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Owns a set of transient attachments and their memory.
+*
+* If the device has a lazily allocated memory type - as tile-based GPUs do
+* - the attachments go there and only take up physical memory if the
+* render pass spills them out of tile memory, which it usually does not.
+* Everywhere else, each alias group is placed into a single allocation
+* which is as large as the largest attachment of the group.
+*
+* Add() all attachments, then Commit() once to bind memory and create the
+* views. Aliased attachments start with undefined contents every time a
+* different member of the group was written in between, so transition
+* them from VK_IMAGE_LAYOUT_UNDEFINED on every use.
+*/
+class TransientAttachmentPool
+{
+public:
+    TransientAttachmentPool(const TransientAttachmentPool&) = delete;
+    TransientAttachmentPool& operator= (const TransientAttachmentPool&) = delete;
+
+    TransientAttachmentPool(VkDevice device, DeviceMemoryAllocator& allocator,
+        const DeviceMemoryProperties& memoryProperties,
+        const VkAllocationCallbacks* allocationCallbacks = nullptr);
+    ~TransientAttachmentPool();
+
+    /**
+    * Create the image for an attachment and return its index. Must be
+    * called before Commit().
+    */
+    int Add(const TransientAttachmentDesc& desc);
+
+    /**
+    * Allocate and bind memory for all attachments, and create their views.
+    * Returns false if memory could not be allocated.
+    */
+    bool Commit();
+
+    VkImage GetImage(const int index) const
+    {
+        return attachments_[index].image;
+    }
+
+    VkImageView GetView(const int index) const
+    {
+        return attachments_[index].view;
+    }
+
+    /**
+    * True if the attachment was placed into lazily allocated memory.
+    */
+    bool IsLazilyAllocated(const int index) const
+    {
+        return attachments_[index].lazilyAllocated;
+    }
+
+    /**
+    * Device memory allocated for the attachments, not counting lazily
+    * allocated memory.
+    */
+    VkDeviceSize GetCommittedSize() const
+    {
+        return committedSize_;
+    }
+
+    /**
+    * Destroy all attachments and free their memory. The caller must make
+    * sure the device is done with them.
+    */
+    void Clear();
+
+private:
+    struct Attachment
+    {
+        TransientAttachmentDesc desc;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        // Index into allocations_, shared by all members of an alias group
+        int allocation = -1;
+        bool lazilyAllocated = false;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    const VkAllocationCallbacks* allocationCallbacks_ = nullptr;
+    DeviceMemoryAllocator& allocator_;
+    const DeviceMemoryProperties& memoryProperties_;
+
+    std::vector<Attachment> attachments_;
+    std::vector<DeviceMemoryAllocation> allocations_;
+    VkDeviceSize committedSize_ = 0;
+    bool committed_ = false;
+};
+}   // namespace AMD
+
+#endif
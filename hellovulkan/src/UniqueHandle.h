@@ -0,0 +1,219 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_UNIQUEHANDLE_H_
+#define AMD_VULKAN_SAMPLE_UNIQUEHANDLE_H_
+
+#include "DeferredDeletionQueue.h"
+#include "DeviceMemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Owns a Vulkan object created from a device. Resetting or destroying the
+* wrapper does not destroy the object right away, it goes through the
+* deletion queue so frames in flight can keep using it.
+*
+* The destroy function is a template parameter instead of being derived
+* from T, because on 32-bit platforms all non-dispatchable handles are the
+* same type.
+*/
+template <typename T,
+    void (VKAPI_PTR *Destroy)(VkDevice, T, const VkAllocationCallbacks*)>
+class UniqueHandle
+{
+public:
+    UniqueHandle(const UniqueHandle&) = delete;
+    UniqueHandle& operator= (const UniqueHandle&) = delete;
+
+    UniqueHandle()
+    {
+    }
+
+    UniqueHandle(T handle, DeferredDeletionQueue& deletionQueue)
+        : handle_(handle)
+        , deletionQueue_(&deletionQueue)
+    {
+    }
+
+    UniqueHandle(UniqueHandle&& other)
+        : handle_(other.handle_)
+        , deletionQueue_(other.deletionQueue_)
+    {
+        other.handle_ = VK_NULL_HANDLE;
+    }
+
+    UniqueHandle& operator= (UniqueHandle&& other)
+    {
+        if (this != &other)
+        {
+            Reset();
+
+            handle_ = other.handle_;
+            deletionQueue_ = other.deletionQueue_;
+            other.handle_ = VK_NULL_HANDLE;
+        }
+
+        return *this;
+    }
+
+    ~UniqueHandle()
+    {
+        Reset();
+    }
+
+    T Get() const
+    {
+        return handle_;
+    }
+
+    /**
+    * For the create info structures which take arrays of handles.
+    */
+    const T* GetAddress() const
+    {
+        return &handle_;
+    }
+
+    /**
+    * Destroy the object once all frames submitted so far have retired.
+    */
+    void Reset()
+    {
+        if (handle_ == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        const VkDevice device = deletionQueue_->GetDevice();
+        const VkAllocationCallbacks* allocationCallbacks =
+            deletionQueue_->GetAllocationCallbacks();
+        const T handle = handle_;
+
+        deletionQueue_->Enqueue([device, allocationCallbacks, handle]() {
+            Destroy(device, handle, allocationCallbacks);
+        });
+
+        handle_ = VK_NULL_HANDLE;
+    }
+
+private:
+    T handle_ = VK_NULL_HANDLE;
+    DeferredDeletionQueue* deletionQueue_ = nullptr;
+};
+
+typedef UniqueHandle<VkBuffer, vkDestroyBuffer> UniqueBuffer;
+typedef UniqueHandle<VkImage, vkDestroyImage> UniqueImage;
+typedef UniqueHandle<VkImageView, vkDestroyImageView> UniqueImageView;
+typedef UniqueHandle<VkSampler, vkDestroySampler> UniqueSampler;
+typedef UniqueHandle<VkShaderModule, vkDestroyShaderModule> UniqueShaderModule;
+typedef UniqueHandle<VkPipeline, vkDestroyPipeline> UniquePipeline;
+typedef UniqueHandle<VkPipelineLayout, vkDestroyPipelineLayout> UniquePipelineLayout;
+typedef UniqueHandle<VkDescriptorSetLayout, vkDestroyDescriptorSetLayout> UniqueDescriptorSetLayout;
+typedef UniqueHandle<VkDescriptorPool, vkDestroyDescriptorPool> UniqueDescriptorPool;
+typedef UniqueHandle<VkFramebuffer, vkDestroyFramebuffer> UniqueFramebuffer;
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Owns a DeviceMemoryAllocation, which is freed through the deletion queue
+* like the objects bound to it.
+*/
+class UniqueAllocation
+{
+public:
+    UniqueAllocation(const UniqueAllocation&) = delete;
+    UniqueAllocation& operator= (const UniqueAllocation&) = delete;
+
+    UniqueAllocation()
+    {
+    }
+
+    UniqueAllocation(const DeviceMemoryAllocation& allocation,
+        DeferredDeletionQueue& deletionQueue)
+        : allocation_(allocation)
+        , deletionQueue_(&deletionQueue)
+    {
+    }
+
+    UniqueAllocation(UniqueAllocation&& other)
+        : allocation_(other.allocation_)
+        , deletionQueue_(other.deletionQueue_)
+    {
+        other.allocation_ = DeviceMemoryAllocation();
+    }
+
+    UniqueAllocation& operator= (UniqueAllocation&& other)
+    {
+        if (this != &other)
+        {
+            Reset();
+
+            allocation_ = other.allocation_;
+            deletionQueue_ = other.deletionQueue_;
+            other.allocation_ = DeviceMemoryAllocation();
+        }
+
+        return *this;
+    }
+
+    ~UniqueAllocation()
+    {
+        Reset();
+    }
+
+    const DeviceMemoryAllocation& Get() const
+    {
+        return allocation_;
+    }
+
+    const DeviceMemoryAllocation* operator-> () const
+    {
+        return &allocation_;
+    }
+
+    void Reset()
+    {
+        if (allocation_.memory == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        DeviceMemoryAllocator* allocator = &deletionQueue_->GetAllocator();
+        DeviceMemoryAllocation allocation = allocation_;
+
+        deletionQueue_->Enqueue([allocator, allocation]() mutable {
+            allocator->Free(allocation);
+        });
+
+        allocation_ = DeviceMemoryAllocation();
+    }
+
+private:
+    DeviceMemoryAllocation allocation_;
+    DeferredDeletionQueue* deletionQueue_ = nullptr;
+};
+}   // namespace AMD
+
+#endif
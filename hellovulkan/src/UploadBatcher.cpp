@@ -0,0 +1,494 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "UploadBatcher.h"
+
+#include "DeviceMemoryAllocator.h"
+#include "StagingRing.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <functional>
+
+namespace AMD
+{
+namespace
+{
+///////////////////////////////////////////////////////////////////////////////
+bool AddStagedData(StagingRing& stagingRing, const void* data,
+    const VkDeviceSize size, StagingRegion* outputRegion)
+{
+    if (!stagingRing.Allocate(size, 4, outputRegion))
+    {
+        return false;
+    }
+
+    ::memcpy(outputRegion->mappedData, data, static_cast<size_t> (size));
+    stagingRing.MarkDirty(*outputRegion);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+void SetQueueFamilies(T& barrier, const UploadBarrierMode mode,
+    const uint32_t srcQueueFamilyIndex, const uint32_t dstQueueFamilyIndex)
+{
+    barrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+    barrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+
+    // The access masks only apply on the queue they belong to
+    if (mode == UBM_Release)
+    {
+        barrier.dstAccessMask = 0;
+    }
+    else if (mode == UBM_Acquire)
+    {
+        barrier.srcAccessMask = 0;
+    }
+}
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+UploadBatcher::UploadBatcher(DeviceMemoryAllocator& allocator,
+    StagingRing& stagingRing)
+    : allocator_(allocator)
+    , stagingRing_(stagingRing)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool UploadBatcher::AddBufferUpload(VkBuffer buffer, const VkDeviceSize offset,
+    const void* data, const VkDeviceSize size,
+    const VkPipelineStageFlags dstStageMask, const VkAccessFlags dstAccessMask)
+{
+    assert(dstStageMask != 0);
+
+    StagingRegion stagingRegion;
+    if (!AddStagedData(stagingRing_, data, size, &stagingRegion))
+    {
+        return false;
+    }
+
+    BufferUpload upload;
+    upload.buffer = buffer;
+    upload.stagingBuffer = stagingRegion.buffer;
+    upload.region.srcOffset = stagingRegion.offset;
+    upload.region.dstOffset = offset;
+    upload.region.size = size;
+    upload.dstStageMask = dstStageMask;
+    upload.dstAccessMask = dstAccessMask;
+
+    bufferUploads_.push_back(upload);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool UploadBatcher::AddBufferUpload(VkBuffer buffer,
+    const DeviceMemoryAllocation& memory, const VkDeviceSize offset,
+    const void* data, const VkDeviceSize size,
+    const VkPipelineStageFlags dstStageMask, const VkAccessFlags dstAccessMask)
+{
+    if (memory.mappedData == nullptr)
+    {
+        return AddBufferUpload(buffer, offset, data, size, dstStageMask,
+            dstAccessMask);
+    }
+
+    assert(offset + size <= memory.size);
+
+    ::memcpy(static_cast<uint8_t*> (memory.mappedData) + offset, data,
+        static_cast<size_t> (size));
+    allocator_.MarkDirty(memory, offset, size);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool UploadBatcher::AddImageUpload(VkImage image,
+    const VkImageSubresourceLayers& subresource, const VkExtent3D& extent,
+    const void* data, const VkDeviceSize size, const VkImageLayout layout,
+    const VkPipelineStageFlags dstStageMask, const VkAccessFlags dstAccessMask)
+{
+    void* mappedData = AllocateImageUpload(image, subresource, extent, 0, size,
+        layout, dstStageMask, dstAccessMask);
+
+    if (mappedData == nullptr)
+    {
+        return false;
+    }
+
+    ::memcpy(mappedData, data, static_cast<size_t> (size));
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void* UploadBatcher::AllocateImageUpload(VkImage image,
+    const VkImageSubresourceLayers& subresource, const VkExtent3D& extent,
+    const uint32_t rowLength, const VkDeviceSize size, const VkImageLayout layout,
+    const VkPipelineStageFlags dstStageMask, const VkAccessFlags dstAccessMask)
+{
+    assert(dstStageMask != 0);
+    assert(rowLength == 0 || rowLength >= extent.width);
+
+    StagingRegion stagingRegion;
+    if (!stagingRing_.Allocate(size, 4, &stagingRegion))
+    {
+        return nullptr;
+    }
+
+    // Written by the caller, but flushed before the batch is submitted
+    // either way
+    stagingRing_.MarkDirty(stagingRegion);
+
+    ImageUpload upload = {};
+    upload.image = image;
+    upload.stagingBuffer = stagingRegion.buffer;
+    upload.region.bufferOffset = stagingRegion.offset;
+    upload.region.bufferRowLength = rowLength;
+    upload.region.imageSubresource = subresource;
+    upload.region.imageExtent = extent;
+    upload.layout = layout;
+    upload.dstStageMask = dstStageMask;
+    upload.dstAccessMask = dstAccessMask;
+
+    imageUploads_.push_back(upload);
+    return stagingRegion.mappedData;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void UploadBatcher::AddBarrier(const VkBufferMemoryBarrier& barrier,
+    const VkPipelineStageFlags dstStageMask)
+{
+    assert(dstStageMask != 0);
+
+    BufferBarrier bufferBarrier;
+    bufferBarrier.barrier = barrier;
+    bufferBarrier.dstStageMask = dstStageMask;
+    bufferBarriers_.push_back(bufferBarrier);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void UploadBatcher::AddBarrier(const VkImageMemoryBarrier& barrier,
+    const VkPipelineStageFlags dstStageMask)
+{
+    assert(dstStageMask != 0);
+
+    ImageBarrier imageBarrier;
+    imageBarrier.barrier = barrier;
+    imageBarrier.dstStageMask = dstStageMask;
+    imageBarriers_.push_back(imageBarrier);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void UploadBatcher::RecordCopies(VkCommandBuffer commandBuffer)
+{
+    RecordBufferCopies(commandBuffer);
+    RecordImageCopies(commandBuffer);
+
+    bufferUploads_.clear();
+    imageUploads_.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void UploadBatcher::RecordBufferCopies(VkCommandBuffer commandBuffer)
+{
+    // Stable, so uploads to the same range are copied in the order they
+    // were added
+    std::stable_sort(bufferUploads_.begin(), bufferUploads_.end(),
+        [](const BufferUpload& a, const BufferUpload& b) {
+        if (a.buffer != b.buffer)
+        {
+            return std::less<VkBuffer>()(a.buffer, b.buffer);
+        }
+
+        return a.region.dstOffset < b.region.dstOffset;
+    });
+
+    std::vector<VkBufferCopy> regions;
+
+    for (std::size_t i = 0; i < bufferUploads_.size(); )
+    {
+        const VkBuffer buffer = bufferUploads_[i].buffer;
+
+        BufferBarrier bufferBarrier = {};
+        bufferBarrier.barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarrier.barrier.buffer = buffer;
+        bufferBarrier.barrier.offset = bufferUploads_[i].region.dstOffset;
+
+        VkDeviceSize end = 0;
+        VkBuffer stagingBuffer = bufferUploads_[i].stagingBuffer;
+        regions.clear();
+
+        for (; i < bufferUploads_.size() && bufferUploads_[i].buffer == buffer; ++i)
+        {
+            const auto& upload = bufferUploads_[i];
+
+            // Uploads which didn't fit into the staging ring come from a
+            // buffer of their own, and need a copy command of their own
+            if (upload.stagingBuffer != stagingBuffer)
+            {
+                vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer,
+                    static_cast<uint32_t> (regions.size()), regions.data());
+
+                stagingBuffer = upload.stagingBuffer;
+                regions.clear();
+            }
+
+            // Uploads added one after the other are usually adjacent in
+            // the staging ring as well
+            if (!regions.empty() &&
+                regions.back().srcOffset + regions.back().size == upload.region.srcOffset &&
+                regions.back().dstOffset + regions.back().size == upload.region.dstOffset)
+            {
+                regions.back().size += upload.region.size;
+            }
+            else
+            {
+                regions.push_back(upload.region);
+            }
+
+            end = std::max(end, upload.region.dstOffset + upload.region.size);
+            bufferBarrier.barrier.dstAccessMask |= upload.dstAccessMask;
+            bufferBarrier.dstStageMask |= upload.dstStageMask;
+        }
+
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer,
+            static_cast<uint32_t> (regions.size()), regions.data());
+
+        bufferBarrier.barrier.size = end - bufferBarrier.barrier.offset;
+        bufferBarriers_.push_back(bufferBarrier);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void UploadBatcher::RecordImageCopies(VkCommandBuffer commandBuffer)
+{
+    if (imageUploads_.empty())
+    {
+        return;
+    }
+
+    std::stable_sort(imageUploads_.begin(), imageUploads_.end(),
+        [](const ImageUpload& a, const ImageUpload& b) {
+        return std::less<VkImage>()(a.image, b.image);
+    });
+
+    // One transition per image covering all uploaded subresources, first
+    // into the copy layout, then into the final one
+    std::vector<VkImageMemoryBarrier> preCopyBarriers;
+    std::vector<std::size_t> imageStarts;
+
+    for (std::size_t i = 0; i < imageUploads_.size(); )
+    {
+        const VkImage image = imageUploads_[i].image;
+        const VkImageSubresourceLayers& first = imageUploads_[i].region.imageSubresource;
+
+        VkImageSubresourceRange range = {};
+        range.baseMipLevel = first.mipLevel;
+        range.baseArrayLayer = first.baseArrayLayer;
+
+        uint32_t mipEnd = 0;
+        uint32_t layerEnd = 0;
+
+        ImageBarrier imageBarrier = {};
+        imageBarrier.barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageBarrier.barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarrier.barrier.newLayout = imageUploads_[i].layout;
+        imageBarrier.barrier.image = image;
+
+        imageStarts.push_back(i);
+
+        for (; i < imageUploads_.size() && imageUploads_[i].image == image; ++i)
+        {
+            const auto& upload = imageUploads_[i];
+            const VkImageSubresourceLayers& subresource = upload.region.imageSubresource;
+
+            assert(upload.layout == imageBarrier.barrier.newLayout);
+
+            range.aspectMask |= subresource.aspectMask;
+            range.baseMipLevel = std::min(range.baseMipLevel, subresource.mipLevel);
+            range.baseArrayLayer = std::min(range.baseArrayLayer, subresource.baseArrayLayer);
+            mipEnd = std::max(mipEnd, subresource.mipLevel + 1);
+            layerEnd = std::max(layerEnd,
+                subresource.baseArrayLayer + subresource.layerCount);
+
+            imageBarrier.barrier.dstAccessMask |= upload.dstAccessMask;
+            imageBarrier.dstStageMask |= upload.dstStageMask;
+        }
+
+        range.levelCount = mipEnd - range.baseMipLevel;
+        range.layerCount = layerEnd - range.baseArrayLayer;
+
+        VkImageMemoryBarrier preCopyBarrier = {};
+        preCopyBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        preCopyBarrier.srcAccessMask = 0;
+        preCopyBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        preCopyBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        preCopyBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        preCopyBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        preCopyBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        preCopyBarrier.image = image;
+        preCopyBarrier.subresourceRange = range;
+        preCopyBarriers.push_back(preCopyBarrier);
+
+        imageBarrier.barrier.subresourceRange = range;
+        imageBarriers_.push_back(imageBarrier);
+    }
+
+    imageStarts.push_back(imageUploads_.size());
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+        static_cast<uint32_t> (preCopyBarriers.size()), preCopyBarriers.data());
+
+    std::vector<VkBufferImageCopy> regions;
+
+    for (std::size_t i = 0; i + 1 < imageStarts.size(); ++i)
+    {
+        const VkImage image = imageUploads_[imageStarts[i]].image;
+        VkBuffer stagingBuffer = imageUploads_[imageStarts[i]].stagingBuffer;
+        regions.clear();
+
+        for (std::size_t j = imageStarts[i]; j < imageStarts[i + 1]; ++j)
+        {
+            if (imageUploads_[j].stagingBuffer != stagingBuffer)
+            {
+                vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, image,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    static_cast<uint32_t> (regions.size()), regions.data());
+
+                stagingBuffer = imageUploads_[j].stagingBuffer;
+                regions.clear();
+            }
+
+            regions.push_back(imageUploads_[j].region);
+        }
+
+        vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t> (regions.size()), regions.data());
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void UploadBatcher::RecordBarriers(VkCommandBuffer commandBuffer,
+    const UploadBarrierMode mode, const uint32_t srcQueueFamilyIndex,
+    const uint32_t dstQueueFamilyIndex)
+{
+    if (bufferBarriers_.empty() && imageBarriers_.empty())
+    {
+        return;
+    }
+
+    // The release half has nothing to wait for on its queue, so all of it
+    // goes into one barrier. Otherwise there is one per destination stage
+    // mask, so a barrier for the vertex input does not hold up the
+    // fragment shader.
+    std::vector<VkPipelineStageFlags> dstStageMasks;
+
+    if (mode == UBM_Release)
+    {
+        dstStageMasks.push_back(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    }
+    else
+    {
+        for (const auto& bufferBarrier : bufferBarriers_)
+        {
+            if (std::find(dstStageMasks.begin(), dstStageMasks.end(),
+                bufferBarrier.dstStageMask) == dstStageMasks.end())
+            {
+                dstStageMasks.push_back(bufferBarrier.dstStageMask);
+            }
+        }
+
+        for (const auto& imageBarrier : imageBarriers_)
+        {
+            if (std::find(dstStageMasks.begin(), dstStageMasks.end(),
+                imageBarrier.dstStageMask) == dstStageMasks.end())
+            {
+                dstStageMasks.push_back(imageBarrier.dstStageMask);
+            }
+        }
+    }
+
+    // Matches the stage the semaphore wait blocks for the acquire half
+    const VkPipelineStageFlags srcStageMask = (mode == UBM_Acquire)
+        ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT
+        : VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+
+    for (const auto dstStageMask : dstStageMasks)
+    {
+        bufferBarriers.clear();
+        imageBarriers.clear();
+
+        for (const auto& bufferBarrier : bufferBarriers_)
+        {
+            if (mode == UBM_Release || bufferBarrier.dstStageMask == dstStageMask)
+            {
+                bufferBarriers.push_back(bufferBarrier.barrier);
+                SetQueueFamilies(bufferBarriers.back(), mode,
+                    srcQueueFamilyIndex, dstQueueFamilyIndex);
+            }
+        }
+
+        for (const auto& imageBarrier : imageBarriers_)
+        {
+            if (mode == UBM_Release || imageBarrier.dstStageMask == dstStageMask)
+            {
+                imageBarriers.push_back(imageBarrier.barrier);
+                SetQueueFamilies(imageBarriers.back(), mode,
+                    srcQueueFamilyIndex, dstQueueFamilyIndex);
+            }
+        }
+
+        vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0,
+            0, nullptr,
+            static_cast<uint32_t> (bufferBarriers.size()), bufferBarriers.data(),
+            static_cast<uint32_t> (imageBarriers.size()), imageBarriers.data());
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void UploadBatcher::Record(VkCommandBuffer commandBuffer)
+{
+    RecordCopies(commandBuffer);
+    RecordBarriers(commandBuffer, UBM_Local, VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED);
+    Clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void UploadBatcher::Clear()
+{
+    bufferUploads_.clear();
+    imageUploads_.clear();
+    bufferBarriers_.clear();
+    imageBarriers_.clear();
+}
+}   // namespace AMD
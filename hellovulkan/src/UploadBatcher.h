@@ -0,0 +1,190 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_UPLOADBATCHER_H_
+#define AMD_VULKAN_SAMPLE_UPLOADBATCHER_H_
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+namespace AMD
+{
+class DeviceMemoryAllocator;
+class StagingRing;
+struct DeviceMemoryAllocation;
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* How UploadBatcher::RecordBarriers() hands the destinations over. Local
+* is a plain barrier on the queue which copied, Release and Acquire are
+* the two halves of an ownership transfer to another queue family.
+*/
+enum UploadBarrierMode
+{
+    UBM_Local,
+    UBM_Release,
+    UBM_Acquire
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Collects the uploads of a frame or an initialization phase and records
+* them in one go.
+*
+* The data is written to the staging ring right away. Recording sorts the
+* copies by destination and merges regions which are adjacent in both
+* the staging ring and the destination, so every destination gets one
+* copy command - one more for each upload which overflowed the ring into
+* a buffer of its own. Image layout transitions before the copies go into one
+* pipeline barrier, and the barriers after the copies into one pipeline
+* barrier per destination stage mask.
+*
+* The destinations must not be in use by the device - the batcher is
+* meant for new resources, and images are transitioned from
+* VK_IMAGE_LAYOUT_UNDEFINED.
+*/
+class UploadBatcher
+{
+public:
+    UploadBatcher(const UploadBatcher&) = delete;
+    UploadBatcher& operator= (const UploadBatcher&) = delete;
+
+    UploadBatcher(DeviceMemoryAllocator& allocator, StagingRing& stagingRing);
+
+    /**
+    * Copy size bytes from data to buffer at offset. dstStageMask and
+    * dstAccessMask describe the first use after the upload. Returns false
+    * if no staging memory could be allocated for the data, see
+    * StagingRing::Allocate().
+    */
+    bool AddBufferUpload(VkBuffer buffer, const VkDeviceSize offset,
+        const void* data, const VkDeviceSize size,
+        const VkPipelineStageFlags dstStageMask, const VkAccessFlags dstAccessMask);
+
+    /**
+    * If memory - the allocation bound to buffer - is mapped, write the data
+    * directly and flush it with the allocator's next FlushDirtyRanges().
+    * There is no copy and no barrier in that case, submitting the work
+    * makes host writes visible. Otherwise, the data is staged as above.
+    */
+    bool AddBufferUpload(VkBuffer buffer, const DeviceMemoryAllocation& memory,
+        const VkDeviceSize offset, const void* data, const VkDeviceSize size,
+        const VkPipelineStageFlags dstStageMask, const VkAccessFlags dstAccessMask);
+
+    /**
+    * Copy tightly packed texel data to one subresource of image. The image
+    * ends up in layout, which must be the same for all uploads to it.
+    */
+    bool AddImageUpload(VkImage image, const VkImageSubresourceLayers& subresource,
+        const VkExtent3D& extent, const void* data, const VkDeviceSize size,
+        const VkImageLayout layout, const VkPipelineStageFlags dstStageMask,
+        const VkAccessFlags dstAccessMask);
+
+    /**
+    * Like AddImageUpload(), but the caller writes the texel data to the
+    * returned mapping before the batch is submitted - for instance by
+    * decoding straight into it. Rows are rowLength texels apart, 0 means
+    * tightly packed. Returns nullptr if no staging memory could be
+    * allocated, nothing is recorded for the image in that case.
+    */
+    void* AllocateImageUpload(VkImage image, const VkImageSubresourceLayers& subresource,
+        const VkExtent3D& extent, const uint32_t rowLength, const VkDeviceSize size,
+        const VkImageLayout layout, const VkPipelineStageFlags dstStageMask,
+        const VkAccessFlags dstAccessMask);
+
+    /**
+    * Add a barrier after copies recorded by hand, so it is batched with
+    * the others. The transition must start at the transfer stage.
+    */
+    void AddBarrier(const VkBufferMemoryBarrier& barrier,
+        const VkPipelineStageFlags dstStageMask);
+    void AddBarrier(const VkImageMemoryBarrier& barrier,
+        const VkPipelineStageFlags dstStageMask);
+
+    /**
+    * Record the layout transitions and copies for all uploads added so
+    * far. The barriers after them are kept for RecordBarriers().
+    */
+    void RecordCopies(VkCommandBuffer commandBuffer);
+
+    /**
+    * Record the barriers after the copies, setting the queue family
+    * indices - VK_QUEUE_FAMILY_IGNORED for UBM_Local. Both halves of an
+    * ownership transfer use the same barriers, call Clear() once the
+    * last one is recorded.
+    */
+    void RecordBarriers(VkCommandBuffer commandBuffer, const UploadBarrierMode mode,
+        const uint32_t srcQueueFamilyIndex, const uint32_t dstQueueFamilyIndex);
+
+    /**
+    * RecordCopies(), a local RecordBarriers() and Clear() in one.
+    */
+    void Record(VkCommandBuffer commandBuffer);
+
+    void Clear();
+
+private:
+    struct BufferUpload
+    {
+        VkBuffer buffer;
+        VkBuffer stagingBuffer;
+        VkBufferCopy region;
+        VkPipelineStageFlags dstStageMask;
+        VkAccessFlags dstAccessMask;
+    };
+
+    struct ImageUpload
+    {
+        VkImage image;
+        VkBuffer stagingBuffer;
+        VkBufferImageCopy region;
+        VkImageLayout layout;
+        VkPipelineStageFlags dstStageMask;
+        VkAccessFlags dstAccessMask;
+    };
+
+    struct BufferBarrier
+    {
+        VkBufferMemoryBarrier barrier;
+        VkPipelineStageFlags dstStageMask;
+    };
+
+    struct ImageBarrier
+    {
+        VkImageMemoryBarrier barrier;
+        VkPipelineStageFlags dstStageMask;
+    };
+
+    void RecordBufferCopies(VkCommandBuffer commandBuffer);
+    void RecordImageCopies(VkCommandBuffer commandBuffer);
+
+    DeviceMemoryAllocator& allocator_;
+    StagingRing& stagingRing_;
+
+    std::vector<BufferUpload> bufferUploads_;
+    std::vector<ImageUpload> imageUploads_;
+    std::vector<BufferBarrier> bufferBarriers_;
+    std::vector<ImageBarrier> imageBarriers_;
+};
+}   // namespace AMD
+
+#endif
@@ -22,7 +22,12 @@
 
 #include "Utility.h"
 
-#include <stdio.h>
+#include <cstdio>
+#include <cstdarg>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 std::vector<std::uint8_t> ReadFile(const char* filename)
@@ -48,3 +53,20 @@ std::vector<std::uint8_t> ReadFile(const char* filename)
 
     return result;
 }
+
+///////////////////////////////////////////////////////////////////////////////
+void DebugPrint(const char* format, ...)
+{
+    char buffer[2048];
+
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+#ifdef _WIN32
+    ::OutputDebugStringA(buffer);
+#else
+    std::fputs(buffer, stderr);
+#endif
+}
@@ -35,4 +35,10 @@ T RoundToNextMultiple(const T a, const T multiple)
 
 std::vector<std::uint8_t> ReadFile(const char* filename);
 
+/**
+* printf-style debug output. Goes to the debugger on Windows and to stderr
+* everywhere else.
+*/
+void DebugPrint(const char* format, ...);
+
 #endif
@@ -23,141 +23,68 @@
 #include "VulkanQuad.h"
 
 #include "Shaders.h"
+#include "UploadBatcher.h"
 #include "Utility.h"
 #include "Window.h"
 
+#include <cassert>
 #include <vector>
 
 namespace AMD {
 ///////////////////////////////////////////////////////////////////////////////
-void VulkanQuad::ShutdownImpl ()
+VulkanQuad::VulkanQuad (const SampleOptions& options)
+    : VulkanSample (options)
 {
-    vkDestroyPipeline (device_, pipeline_, nullptr);
-    vkDestroyPipelineLayout (device_, pipelineLayout_, nullptr);
-
-    vkDestroyBuffer (device_, vertexBuffer_, nullptr);
-    vkDestroyBuffer (device_, indexBuffer_, nullptr);
-    vkFreeMemory (device_, deviceMemory_, nullptr);
-
-    vkDestroyShaderModule (device_, vertexShader_, nullptr);
-    vkDestroyShaderModule (device_, fragmentShader_, nullptr);
-
-    VulkanSample::ShutdownImpl ();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-void VulkanQuad::RenderImpl (VkCommandBuffer commandBuffer)
+int VulkanQuad::GetRenderTaskCount () const
 {
-    VulkanSample::RenderImpl (commandBuffer);
-
-    vkCmdBindPipeline (commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-        pipeline_);
-    VkDeviceSize offsets [] = { 0 };
-    vkCmdBindIndexBuffer (commandBuffer, indexBuffer_, 0, VK_INDEX_TYPE_UINT32);
-    vkCmdBindVertexBuffers (commandBuffer, 0, 1, &vertexBuffer_, offsets);
-    vkCmdDrawIndexed (commandBuffer, 6, 1, 0, 0, 0);
+    // The whole quad is a single task, so it can be recorded on a worker
+    // thread if the sample is configured to use them
+    return 1;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-void VulkanQuad::InitializeImpl (VkCommandBuffer uploadCommandBuffer)
+void VulkanQuad::RenderTaskImpl (VkCommandBuffer commandBuffer, const int /* taskIndex */)
 {
-    VulkanSample::InitializeImpl (uploadCommandBuffer);
-
-    CreatePipelineStateObject ();
-    CreateMeshBuffers (uploadCommandBuffer);
-}
-
-namespace {
-struct MemoryTypeInfo
-{
-    bool deviceLocal = false;
-    bool hostVisible = false;
-    bool hostCoherent = false;
-    bool hostCached = false;
-    bool lazilyAllocated = false;
-
-    struct Heap
-    {
-        uint64_t size = 0;
-        bool deviceLocal = false;
-    };
-
-    Heap heap;
-    int index;
-};
-
-///////////////////////////////////////////////////////////////////////////////
-std::vector<MemoryTypeInfo> EnumerateHeaps (VkPhysicalDevice device)
-{
-    VkPhysicalDeviceMemoryProperties memoryProperties = {};
-    vkGetPhysicalDeviceMemoryProperties (device, &memoryProperties);
-
-    std::vector<MemoryTypeInfo::Heap> heaps;
-
-    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
-    {
-        MemoryTypeInfo::Heap info;
-        info.size = memoryProperties.memoryHeaps [i].size;
-        info.deviceLocal = (memoryProperties.memoryHeaps [i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
-
-        heaps.push_back (info);
-    }
-
-    std::vector<MemoryTypeInfo> result;
-
-    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-    {
-        MemoryTypeInfo typeInfo;
-
-        typeInfo.deviceLocal = (memoryProperties.memoryTypes [i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
-        typeInfo.hostVisible = (memoryProperties.memoryTypes [i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
-        typeInfo.hostCoherent = (memoryProperties.memoryTypes [i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
-        typeInfo.hostCached = (memoryProperties.memoryTypes [i].propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
-        typeInfo.lazilyAllocated = (memoryProperties.memoryTypes [i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+    vkCmdBindPipeline (commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipeline_.Get ());
 
-        typeInfo.heap = heaps [memoryProperties.memoryTypes [i].heapIndex];
+    const VkExtent2D renderExtent = GetRenderExtent ();
 
-        typeInfo.index = static_cast<int> (i);
+    VkViewport viewport = {};
+    viewport.width = static_cast<float> (renderExtent.width);
+    viewport.height = static_cast<float> (renderExtent.height);
+    viewport.minDepth = 0;
+    viewport.maxDepth = 1;
+    vkCmdSetViewport (commandBuffer, 0, 1, &viewport);
 
-        result.push_back (typeInfo);
-    }
+    VkRect2D scissor = {};
+    scissor.extent = renderExtent;
+    vkCmdSetScissor (commandBuffer, 0, 1, &scissor);
 
-    return result;
+    VkDeviceSize offsets [] = { 0 };
+    vkCmdBindIndexBuffer (commandBuffer, indexBuffer_.Get (), 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindVertexBuffers (commandBuffer, 0, 1, vertexBuffer_.GetAddress (), offsets);
+    vkCmdDrawIndexed (commandBuffer, 6, 1, 0, 0, 0);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-VkDeviceMemory AllocateMemory (const std::vector<MemoryTypeInfo>& memoryInfos,
-    VkDevice device, const int size, bool* isHostCoherent = nullptr)
+bool VulkanQuad::InitializeImpl (VkCommandBuffer uploadCommandBuffer)
 {
-    // We take the first HOST_VISIBLE memory
-    for (auto& memoryInfo : memoryInfos)
-    {
-        if (memoryInfo.hostVisible)
-        {
-            VkMemoryAllocateInfo memoryAllocateInfo = {};
-            memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            memoryAllocateInfo.memoryTypeIndex = memoryInfo.index;
-            memoryAllocateInfo.allocationSize = size;
-
-            VkDeviceMemory deviceMemory;
-            vkAllocateMemory (device, &memoryAllocateInfo, nullptr,
-                &deviceMemory);
-
-            if (isHostCoherent)
-            {
-                *isHostCoherent = memoryInfo.hostCoherent;
-            }
-
-            return deviceMemory;
-        }
-    }
+    VulkanSample::InitializeImpl (uploadCommandBuffer);
 
-    return VK_NULL_HANDLE;
+    // The mesh is needed by the first frame, so it does not go through the
+    // possibly asynchronous upload command buffer
+    CreatePipelineStateObject ();
+    return CreateMeshBuffers (GetSetupCommandBuffer ());
 }
 
+namespace {
 ///////////////////////////////////////////////////////////////////////////////
 VkBuffer AllocateBuffer (VkDevice device, const int size,
-    const VkBufferUsageFlagBits bits)
+    const VkBufferUsageFlags bits, const VkAllocationCallbacks* allocationCallbacks)
 {
     VkBufferCreateInfo bufferCreateInfo = {};
     bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -165,18 +92,19 @@ VkBuffer AllocateBuffer (VkDevice device, const int size,
     bufferCreateInfo.usage = bits;
 
     VkBuffer result;
-    vkCreateBuffer (device, &bufferCreateInfo, nullptr, &result);
+    vkCreateBuffer (device, &bufferCreateInfo, allocationCallbacks, &result);
     return result;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-VkPipelineLayout CreatePipelineLayout (VkDevice device)
+VkPipelineLayout CreatePipelineLayout (VkDevice device,
+    const VkAllocationCallbacks* allocationCallbacks)
 {
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
     pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 
     VkPipelineLayout result;
-    vkCreatePipelineLayout (device, &pipelineLayoutCreateInfo, nullptr,
+    vkCreatePipelineLayout (device, &pipelineLayoutCreateInfo, allocationCallbacks,
         &result);
 
     return result;
@@ -184,7 +112,7 @@ VkPipelineLayout CreatePipelineLayout (VkDevice device)
 
 ///////////////////////////////////////////////////////////////////////////////
 VkShaderModule LoadShader (VkDevice device, const void* shaderContents,
-    const size_t size)
+    const size_t size, const VkAllocationCallbacks* allocationCallbacks)
 {
     VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
     shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -193,7 +121,7 @@ VkShaderModule LoadShader (VkDevice device, const void* shaderContents,
     shaderModuleCreateInfo.codeSize = size;
 
     VkShaderModule result;
-    vkCreateShaderModule (device, &shaderModuleCreateInfo, nullptr, &result);
+    vkCreateShaderModule (device, &shaderModuleCreateInfo, allocationCallbacks, &result);
 
     return result;
 }
@@ -201,7 +129,7 @@ VkShaderModule LoadShader (VkDevice device, const void* shaderContents,
 ///////////////////////////////////////////////////////////////////////////////
 VkPipeline CreatePipeline (VkDevice device, VkRenderPass renderPass, VkPipelineLayout layout,
     VkShaderModule vertexShader, VkShaderModule fragmentShader,
-    VkExtent2D viewportSize)
+    const VkAllocationCallbacks* allocationCallbacks)
 {
     VkVertexInputBindingDescription vertexInputBindingDescription;
     vertexInputBindingDescription.binding = 0;
@@ -230,27 +158,22 @@ VkPipeline CreatePipeline (VkDevice device, VkRenderPass renderPass, VkPipelineL
     pipelineInputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     pipelineInputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 
-    VkPipelineViewportStateCreateInfo pipelineViewportStateCreateInfo = {};
-    pipelineViewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    // Viewport and scissor are dynamic so the pipeline survives a
+    // swapchain resize
+    VkDynamicState dynamicStates [] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
 
-    VkViewport viewport;
-    viewport.height = static_cast<float> (viewportSize.height);
-    viewport.width = static_cast<float> (viewportSize.width);
-    viewport.x = 0;
-    viewport.y = 0;
-    viewport.minDepth = 0;
-    viewport.maxDepth = 1;
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCreateInfo.dynamicStateCount = 2;
+    dynamicStateCreateInfo.pDynamicStates = dynamicStates;
 
+    VkPipelineViewportStateCreateInfo pipelineViewportStateCreateInfo = {};
+    pipelineViewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     pipelineViewportStateCreateInfo.viewportCount = 1;
-    pipelineViewportStateCreateInfo.pViewports = &viewport;
-
-    VkRect2D rect;
-    rect.extent = viewportSize;
-    rect.offset.x = 0;
-    rect.offset.y = 0;
-
     pipelineViewportStateCreateInfo.scissorCount = 1;
-    pipelineViewportStateCreateInfo.pScissors = &rect;
 
     VkPipelineColorBlendAttachmentState pipelineColorBlendAttachmentState = {};
     pipelineColorBlendAttachmentState.colorWriteMask = 0xF;
@@ -313,17 +236,18 @@ VkPipeline CreatePipeline (VkDevice device, VkRenderPass renderPass, VkPipelineL
     graphicsPipelineCreateInfo.pMultisampleState = &pipelineMultisampleStateCreateInfo;
     graphicsPipelineCreateInfo.pStages = pipelineShaderStageCreateInfos;
     graphicsPipelineCreateInfo.stageCount = 2;
+    graphicsPipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
 
     VkPipeline pipeline;
     vkCreateGraphicsPipelines (device, VK_NULL_HANDLE, 1, &graphicsPipelineCreateInfo,
-        nullptr, &pipeline);
+        allocationCallbacks, &pipeline);
 
     return pipeline;
 }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-void VulkanQuad::CreateMeshBuffers (VkCommandBuffer /*uploadCommandBuffer*/)
+bool VulkanQuad::CreateMeshBuffers (VkCommandBuffer uploadCommandBuffer)
 {
     struct Vertex
     {
@@ -346,67 +270,85 @@ void VulkanQuad::CreateMeshBuffers (VkCommandBuffer /*uploadCommandBuffer*/)
         0, 1, 2, 2, 3, 0
     };
 
-    auto memoryHeaps = EnumerateHeaps (physicalDevice_);
-    indexBuffer_ = AllocateBuffer(device_, sizeof(indices),
-        VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-    vertexBuffer_ = AllocateBuffer (device_, sizeof (vertices),
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    auto& deletionQueue = GetDeletionQueue ();
+
+    const VkAllocationCallbacks* allocationCallbacks = GetAllocationCallbacks ();
+
+    indexBuffer_ = UniqueBuffer (AllocateBuffer(device_, sizeof(indices),
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        allocationCallbacks), deletionQueue);
+    vertexBuffer_ = UniqueBuffer (AllocateBuffer (device_, sizeof (vertices),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        allocationCallbacks), deletionQueue);
     VkMemoryRequirements vertexBufferMemoryRequirements = {};
-    vkGetBufferMemoryRequirements(device_, vertexBuffer_,
+    vkGetBufferMemoryRequirements(device_, vertexBuffer_.Get (),
         &vertexBufferMemoryRequirements);
     VkMemoryRequirements indexBufferMemoryRequirements = {};
-    vkGetBufferMemoryRequirements(device_, indexBuffer_,
+    vkGetBufferMemoryRequirements(device_, indexBuffer_.Get (),
         &indexBufferMemoryRequirements);
 
-    VkDeviceSize bufferSize = vertexBufferMemoryRequirements.size;
-    // We want to place the index buffer behind the vertex buffer. Need to take
-    // the alignment into account to find the next suitable location
-    VkDeviceSize indexBufferOffset = RoundToNextMultiple(bufferSize,
-        indexBufferMemoryRequirements.alignment);
+    // Written directly by the CPU into device local memory if the device
+    // has resizable BAR, otherwise staged into device local memory - the
+    // GPU reads the mesh every frame, so it should not stay in system
+    // memory
+    auto& allocator = GetDeviceMemoryAllocator ();
+    DeviceMemoryAllocation vertexBufferMemory;
+    DeviceMemoryAllocation indexBufferMemory;
+    if (!allocator.Allocate (vertexBufferMemoryRequirements,
+            GetUploadMemoryUsage (vertexBufferMemoryRequirements), DMRT_Linear,
+            &vertexBufferMemory) ||
+        !allocator.Allocate (indexBufferMemoryRequirements,
+            GetUploadMemoryUsage (indexBufferMemoryRequirements), DMRT_Linear,
+            &indexBufferMemory))
+    {
+        // Nothing uses them yet
+        allocator.Free (vertexBufferMemory);
+        vertexBuffer_.Reset ();
+        indexBuffer_.Reset ();
+        return false;
+    }
 
-    bufferSize = indexBufferOffset + indexBufferMemoryRequirements.size;
-    bool memoryIsHostCoherent = false;
-    deviceMemory_ = AllocateMemory(memoryHeaps, device_,
-        static_cast<int>(bufferSize), &memoryIsHostCoherent);
+    vertexBufferMemory_ = UniqueAllocation (vertexBufferMemory, deletionQueue);
+    indexBufferMemory_ = UniqueAllocation (indexBufferMemory, deletionQueue);
 
-    vkBindBufferMemory (device_, vertexBuffer_, deviceMemory_, 0);
-    vkBindBufferMemory (device_, indexBuffer_, deviceMemory_,
-        indexBufferOffset);
+    vkBindBufferMemory (device_, vertexBuffer_.Get (), vertexBufferMemory_->memory,
+        vertexBufferMemory_->offset);
+    vkBindBufferMemory (device_, indexBuffer_.Get (), indexBufferMemory_->memory,
+        indexBufferMemory_->offset);
 
-    void* mapping = nullptr;
-    vkMapMemory (device_, deviceMemory_, 0, VK_WHOLE_SIZE,
-        0, &mapping);
-    ::memcpy (mapping, vertices, sizeof (vertices));
+    UploadBatcher uploadBatcher (allocator, GetStagingRing ());
 
-    ::memcpy (static_cast<uint8_t*> (mapping) + indexBufferOffset,
-        indices, sizeof (indices));
+    bool staged = uploadBatcher.AddBufferUpload (vertexBuffer_.Get (),
+        vertexBufferMemory_.Get (), 0, vertices, sizeof (vertices),
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+    staged = uploadBatcher.AddBufferUpload (indexBuffer_.Get (),
+        indexBufferMemory_.Get (), 0, indices, sizeof (indices),
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT) && staged;
 
-    if (!memoryIsHostCoherent)
+    if (!staged)
     {
-        VkMappedMemoryRange mappedMemoryRange = {};
-        mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedMemoryRange.memory = deviceMemory_;
-        mappedMemoryRange.offset = 0;
-        mappedMemoryRange.size = VK_WHOLE_SIZE;
-
-        vkFlushMappedMemoryRanges (device_, 1, &mappedMemoryRange);
+        return false;
     }
 
-    vkUnmapMemory (device_, deviceMemory_);
+    uploadBatcher.Record (uploadCommandBuffer);
+    return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 void VulkanQuad::CreatePipelineStateObject ()
 {
-    vertexShader_ = LoadShader (device_, BasicVertexShader, sizeof (BasicVertexShader));
-    fragmentShader_ = LoadShader (device_, BasicFragmentShader, sizeof (BasicFragmentShader));
-
-    pipelineLayout_ = CreatePipelineLayout (device_);
-    VkExtent2D extent = {
-        static_cast<uint32_t> (window_->GetWidth ()),
-        static_cast<uint32_t> (window_->GetHeight ())
-    };
-    pipeline_ = CreatePipeline(device_, renderPass_, pipelineLayout_,
-        vertexShader_, fragmentShader_, extent);
+    auto& deletionQueue = GetDeletionQueue ();
+    const VkAllocationCallbacks* allocationCallbacks = GetAllocationCallbacks ();
+
+    vertexShader_ = UniqueShaderModule (LoadShader (device_, BasicVertexShader,
+        sizeof (BasicVertexShader), allocationCallbacks), deletionQueue);
+    fragmentShader_ = UniqueShaderModule (LoadShader (device_, BasicFragmentShader,
+        sizeof (BasicFragmentShader), allocationCallbacks), deletionQueue);
+
+    pipelineLayout_ = UniquePipelineLayout (CreatePipelineLayout (device_,
+        allocationCallbacks), deletionQueue);
+    pipeline_ = UniquePipeline (CreatePipeline(device_, renderPass_,
+        pipelineLayout_.Get (), vertexShader_.Get (), fragmentShader_.Get (),
+        allocationCallbacks), deletionQueue);
 }
 }
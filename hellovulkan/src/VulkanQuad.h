@@ -24,27 +24,34 @@
 #define AMD_VULKAN_SAMPLE_QUAD_H_
 
 #include "VulkanSample.h"
+#include "UniqueHandle.h"
 
 namespace AMD
 {
 class VulkanQuad : public VulkanSample
 {
+public:
+    explicit VulkanQuad (const SampleOptions& options = SampleOptions ());
+
 private:
     void CreatePipelineStateObject ();
-    void CreateMeshBuffers (VkCommandBuffer uploadCommandList);
-    void RenderImpl (VkCommandBuffer commandList) override;
-    void InitializeImpl (VkCommandBuffer uploadCommandList) override;
-    void ShutdownImpl () override;
+    bool CreateMeshBuffers (VkCommandBuffer uploadCommandList);
+    int GetRenderTaskCount () const override;
+    void RenderTaskImpl (VkCommandBuffer commandList, const int taskIndex) override;
+    bool InitializeImpl (VkCommandBuffer uploadCommandList) override;
 
-    VkDeviceMemory deviceMemory_ = VK_NULL_HANDLE;
-    VkBuffer vertexBuffer_ = VK_NULL_HANDLE;
-    VkBuffer indexBuffer_ = VK_NULL_HANDLE;
+    // Members are destroyed in reverse order, so memory goes after the
+    // objects bound to it
+    UniqueAllocation vertexBufferMemory_;
+    UniqueAllocation indexBufferMemory_;
+    UniqueBuffer vertexBuffer_;
+    UniqueBuffer indexBuffer_;
 
-    VkShaderModule vertexShader_ = VK_NULL_HANDLE;
-    VkShaderModule fragmentShader_ = VK_NULL_HANDLE;
+    UniqueShaderModule vertexShader_;
+    UniqueShaderModule fragmentShader_;
 
-    VkPipeline pipeline_ = VK_NULL_HANDLE;
-    VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+    UniquePipelineLayout pipelineLayout_;
+    UniquePipeline pipeline_;
 };
 }
 
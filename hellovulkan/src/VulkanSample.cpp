@@ -24,8 +24,21 @@
 
 #include <iostream>
 #include <algorithm>
-
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <vector>
+
+#include "CommandAllocator.h"
+#include "DeferredDeletionQueue.h"
+#include "DeviceMemoryAllocator.h"
+#include "DeviceMemoryProperties.h"
+#include "FrameScheduler.h"
+#include "StagingRing.h"
+#include "TransientAttachmentPool.h"
+#include "UploadBatcher.h"
 #include "Utility.h"
+#include "WorkerPool.h"
 #include "Window.h"
 
 #include <cassert>
@@ -38,7 +51,9 @@
 #undef min
 #endif
 
+#ifdef _MSC_VER
 #pragma warning( disable : 4100 ) // disable unreferenced formal parameter warnings
+#endif
 
 namespace AMD
 {
@@ -51,6 +66,10 @@ struct VulkanSample::ImportTable
 
     ImportTable(VkInstance instance, VkDevice device)
     {
+        // No device entry points so far, and no instance ones in release
+        (void)instance;
+        (void)device;
+
 #ifdef _DEBUG
         GET_INSTANCE_ENTRYPOINT(instance, vkCreateDebugReportCallbackEXT);
         GET_INSTANCE_ENTRYPOINT(instance, vkDebugReportMessageEXT);
@@ -70,6 +89,10 @@ struct VulkanSample::ImportTable
 
 namespace
 {
+// Size of the BAR window without resizable BAR
+const VkDeviceSize SmallBarSize = 256 << 20;
+
+#ifdef _DEBUG
 ///////////////////////////////////////////////////////////////////////////////
 VKAPI_ATTR VkBool32 VKAPI_CALL DebugReportCallback(
     VkDebugReportFlagsEXT       /*flags*/,
@@ -81,8 +104,7 @@ VKAPI_ATTR VkBool32 VKAPI_CALL DebugReportCallback(
     const char*                 pMessage,
     void*                       /*pUserData*/)
 {
-    OutputDebugStringA(pMessage);
-    OutputDebugStringA("\n");
+    DebugPrint("%s\n", pMessage);
     return VK_FALSE;
 }
 
@@ -152,13 +174,43 @@ std::vector<const char*> GetDebugDeviceLayerNames(VkPhysicalDevice device)
 
     return result;
 }
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
-void FindPhysicalDeviceWithGraphicsQueue(const std::vector<VkPhysicalDevice>& physicalDevices,
+bool FindPhysicalDeviceWithGraphicsQueue(const std::vector<VkPhysicalDevice>& physicalDevices,
     VkPhysicalDevice* outputDevice, int* outputGraphicsQueueIndex)
 {
     for (auto physicalDevice : physicalDevices)
     {
+        // Frame scheduling is built on timeline semaphores, which are core
+        // in Vulkan 1.2 - but still an optional feature
+        VkPhysicalDeviceProperties physicalDeviceProperties = {};
+        vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+        if (physicalDeviceProperties.apiVersion < VK_API_VERSION_1_2)
+        {
+            DebugPrint("Skipping '%s': Vulkan 1.2 is required, the device "
+                "supports %u.%u\n", physicalDeviceProperties.deviceName,
+                VK_VERSION_MAJOR(physicalDeviceProperties.apiVersion),
+                VK_VERSION_MINOR(physicalDeviceProperties.apiVersion));
+            continue;
+        }
+
+        VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &vulkan12Features;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+        if (!vulkan12Features.timelineSemaphore)
+        {
+            DebugPrint("Skipping '%s': the timelineSemaphore feature is "
+                "required\n", physicalDeviceProperties.deviceName);
+            continue;
+        }
+
         uint32_t queueFamilyPropertyCount = 0;
 
         vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice,
@@ -183,24 +235,37 @@ void FindPhysicalDeviceWithGraphicsQueue(const std::vector<VkPhysicalDevice>& ph
                     *outputGraphicsQueueIndex = i;
                 }
 
-                return;
+                return true;
             }
 
             ++i;
         }
+
+        DebugPrint("Skipping '%s': no graphics queue\n",
+            physicalDeviceProperties.deviceName);
     }
+
+    return false;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-VkInstance CreateInstance()
+VkInstance CreateInstance(const bool headless,
+    const VkAllocationCallbacks* allocationCallbacks)
 {
     VkInstanceCreateInfo instanceCreateInfo = {};
     instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 
-    std::vector<const char*> instanceExtensions =
+    std::vector<const char*> instanceExtensions;
+
+    // Offscreen rendering does not need any surface support, which allows
+    // running on ICDs and machines which can't present
+    if (!headless)
     {
-        "VK_KHR_surface", "VK_KHR_win32_surface"
-    };
+        instanceExtensions.push_back("VK_KHR_surface");
+#ifdef _WIN32
+        instanceExtensions.push_back("VK_KHR_win32_surface");
+#endif
+    }
 
 #ifdef _DEBUG
     auto debugInstanceExtensionNames = GetDebugInstanceExtensionNames();
@@ -224,7 +289,7 @@ VkInstance CreateInstance()
 
     VkApplicationInfo applicationInfo = {};
     applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    applicationInfo.apiVersion = VK_API_VERSION_1_0;
+    applicationInfo.apiVersion = VK_API_VERSION_1_2;
     applicationInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     applicationInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
     applicationInfo.pApplicationName = "AMD Vulkan Sample application";
@@ -233,15 +298,70 @@ VkInstance CreateInstance()
     instanceCreateInfo.pApplicationInfo = &applicationInfo;
 
     VkInstance instance = VK_NULL_HANDLE;
-    vkCreateInstance(&instanceCreateInfo, nullptr, &instance);
+    vkCreateInstance(&instanceCreateInfo, allocationCallbacks, &instance);
 
     return instance;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-void CreateDeviceAndQueue(VkInstance instance, VkDevice* outputDevice,
-    VkQueue* outputQueue, int* outputQueueIndex,
-    VkPhysicalDevice* outputPhysicalDevice)
+bool IsDeviceExtensionSupported(VkPhysicalDevice physicalDevice, const char* name)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr,
+        &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> deviceExtensions{ extensionCount };
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr,
+        &extensionCount, deviceExtensions.data());
+
+    for (const auto& e : deviceExtensions)
+    {
+        if (strcmp(e.extensionName, name) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* A family which can do transfers, but neither graphics nor compute. On
+* discrete GPUs this is usually backed by copy engines which run
+* alongside rendering. Returns -1 if there is none.
+*/
+int FindTransferQueueFamily(VkPhysicalDevice physicalDevice)
+{
+    uint32_t queueFamilyPropertyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice,
+        &queueFamilyPropertyCount, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queueFamilyProperties{ queueFamilyPropertyCount };
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice,
+        &queueFamilyPropertyCount, queueFamilyProperties.data());
+
+    for (uint32_t i = 0; i < queueFamilyPropertyCount; ++i)
+    {
+        const VkQueueFlags queueFlags = queueFamilyProperties[i].queueFlags;
+
+        if ((queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+            !(queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+        {
+            return static_cast<int> (i);
+        }
+    }
+
+    return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool CreateDeviceAndQueue(VkInstance instance, const bool headless,
+    const bool useTransferQueue,
+    VkDevice* outputDevice, VkQueue* outputQueue, int* outputQueueIndex,
+    VkQueue* outputTransferQueue, int* outputTransferQueueIndex,
+    VkPhysicalDevice* outputPhysicalDevice, bool* outputMemoryBudgetEnabled,
+    const VkAllocationCallbacks* allocationCallbacks)
 {
     uint32_t physicalDeviceCount = 0;
     vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, nullptr);
@@ -253,22 +373,31 @@ void CreateDeviceAndQueue(VkInstance instance, VkDevice* outputDevice,
     VkPhysicalDevice physicalDevice = nullptr;
     int graphicsQueueIndex = -1;
 
-    FindPhysicalDeviceWithGraphicsQueue(devices, &physicalDevice, &graphicsQueueIndex);
-
-    assert(physicalDevice);
+    if (!FindPhysicalDeviceWithGraphicsQueue(devices, &physicalDevice, &graphicsQueueIndex))
+    {
+        DebugPrint("No device supports Vulkan 1.2 with timeline semaphores "
+            "and a graphics queue\n");
+        return false;
+    }
 
-    VkDeviceQueueCreateInfo deviceQueueCreateInfo = {};
-    deviceQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    deviceQueueCreateInfo.queueCount = 1;
-    deviceQueueCreateInfo.queueFamilyIndex = graphicsQueueIndex;
+    const int transferQueueIndex = useTransferQueue
+        ? FindTransferQueueFamily(physicalDevice) : -1;
 
     static const float queuePriorities[] = { 1.0f };
-    deviceQueueCreateInfo.pQueuePriorities = queuePriorities;
+
+    VkDeviceQueueCreateInfo deviceQueueCreateInfos[2] = {};
+    deviceQueueCreateInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    deviceQueueCreateInfos[0].queueCount = 1;
+    deviceQueueCreateInfos[0].queueFamilyIndex = graphicsQueueIndex;
+    deviceQueueCreateInfos[0].pQueuePriorities = queuePriorities;
+
+    deviceQueueCreateInfos[1] = deviceQueueCreateInfos[0];
+    deviceQueueCreateInfos[1].queueFamilyIndex = transferQueueIndex;
 
     VkDeviceCreateInfo deviceCreateInfo = {};
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCreateInfo.queueCreateInfoCount = 1;
-    deviceCreateInfo.pQueueCreateInfos = &deviceQueueCreateInfo;
+    deviceCreateInfo.queueCreateInfoCount = transferQueueIndex == -1 ? 1 : 2;
+    deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfos;
 
     std::vector<const char*> deviceLayers;
 
@@ -287,17 +416,40 @@ void CreateDeviceAndQueue(VkInstance instance, VkDevice* outputDevice,
 
 	deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
 
-    std::vector<const char*> deviceExtensions =
+    VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.timelineSemaphore = VK_TRUE;
+
+    deviceCreateInfo.pNext = &vulkan12Features;
+
+    std::vector<const char*> deviceExtensions;
+
+    if (!headless)
     {
-        "VK_KHR_swapchain"
-    };
+        deviceExtensions.push_back("VK_KHR_swapchain");
+    }
+
+    // Optional, without it we only know what we allocated ourselves
+    const bool memoryBudgetSupported = IsDeviceExtensionSupported(physicalDevice,
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    if (memoryBudgetSupported)
+    {
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
 
     deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
     deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t> (deviceExtensions.size());
 
     VkDevice device = nullptr;
-    vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device);
-    assert(device);
+    const VkResult result = vkCreateDevice(physicalDevice, &deviceCreateInfo,
+        allocationCallbacks, &device);
+
+    if (result != VK_SUCCESS)
+    {
+        DebugPrint("vkCreateDevice failed (%d)\n", static_cast<int> (result));
+        return false;
+    }
 
     VkQueue queue = nullptr;
     vkGetDeviceQueue(device, graphicsQueueIndex, 0, &queue);
@@ -318,10 +470,35 @@ void CreateDeviceAndQueue(VkInstance instance, VkDevice* outputDevice,
         *outputQueueIndex = graphicsQueueIndex;
     }
 
+    VkQueue transferQueue = VK_NULL_HANDLE;
+
+    if (transferQueueIndex != -1)
+    {
+        vkGetDeviceQueue(device, transferQueueIndex, 0, &transferQueue);
+        assert(transferQueue);
+    }
+
+    if (outputTransferQueue)
+    {
+        *outputTransferQueue = transferQueue;
+    }
+
+    if (outputTransferQueueIndex)
+    {
+        *outputTransferQueueIndex = transferQueueIndex;
+    }
+
     if (outputPhysicalDevice)
     {
         *outputPhysicalDevice = physicalDevice;
     }
+
+    if (outputMemoryBudgetEnabled)
+    {
+        *outputMemoryBudgetEnabled = memoryBudgetSupported;
+    }
+
+    return true;
 }
 
 struct SwapchainFormatColorSpace
@@ -332,7 +509,7 @@ struct SwapchainFormatColorSpace
 
 ///////////////////////////////////////////////////////////////////////////////
 SwapchainFormatColorSpace GetSwapchainFormatAndColorspace(VkPhysicalDevice physicalDevice,
-    VkSurfaceKHR surface, VulkanSample::ImportTable* importTable)
+    VkSurfaceKHR surface, VulkanSample::ImportTable* /*importTable*/)
 {
     uint32_t surfaceFormatCount = 0;
     vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice,
@@ -359,37 +536,105 @@ SwapchainFormatColorSpace GetSwapchainFormatAndColorspace(VkPhysicalDevice physi
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-VkRenderPass CreateRenderPass(VkDevice device, VkFormat swapchainFormat)
+/**
+* Pick a depth format which can be used as an attachment. Only
+* D16_UNORM is guaranteed, the others have more precision.
+*/
+VkFormat SelectDepthFormat(VkPhysicalDevice physicalDevice)
+{
+    static const VkFormat candidates[] =
+    {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_X8_D24_UNORM_PACK32,
+        VK_FORMAT_D16_UNORM
+    };
+
+    for (const auto format : candidates)
+    {
+        VkFormatProperties formatProperties = {};
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format,
+            &formatProperties);
+
+        if (formatProperties.optimalTilingFeatures &
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+        {
+            return format;
+        }
+    }
+
+    return VK_FORMAT_UNDEFINED;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+VkRenderPass CreateRenderPass(VkDevice device, VkFormat swapchainFormat,
+    VkImageLayout finalLayout, VkFormat depthFormat,
+    const VkAllocationCallbacks* allocationCallbacks)
 {
-    VkAttachmentDescription attachmentDescription = {};
+    VkAttachmentDescription attachmentDescriptions[2] = {};
+    VkAttachmentDescription& attachmentDescription = attachmentDescriptions[0];
     attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
     attachmentDescription.format = swapchainFormat;
     attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    attachmentDescription.finalLayout = finalLayout;
     attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
+    // The depth buffer is transient: nothing before the render pass
+    // produces it and nothing after reads it
+    VkAttachmentDescription& depthAttachmentDescription = attachmentDescriptions[1];
+    depthAttachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachmentDescription.format = depthFormat;
+    depthAttachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachmentDescription.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
     VkAttachmentReference attachmentReference = {};
     attachmentReference.attachment = 0;
     attachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference depthAttachmentReference = {};
+    depthAttachmentReference.attachment = 1;
+    depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    const bool hasDepth = depthFormat != VK_FORMAT_UNDEFINED;
+
     VkSubpassDescription subpassDescription = {};
     subpassDescription.inputAttachmentCount = 0;
     subpassDescription.pColorAttachments = &attachmentReference;
     subpassDescription.colorAttachmentCount = 1;
+    subpassDescription.pDepthStencilAttachment = hasDepth ? &depthAttachmentReference : nullptr;
     subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 
+    // The depth buffer is shared by all frames in flight, so the previous
+    // frame's depth writes must be done before this one clears it
+    VkSubpassDependency subpassDependency = {};
+    subpassDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    subpassDependency.dstSubpass = 0;
+    subpassDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+        | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    subpassDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+        | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    subpassDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    subpassDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
     VkRenderPassCreateInfo renderPassCreateInfo = {};
     renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassCreateInfo.attachmentCount = 1;
+    renderPassCreateInfo.attachmentCount = hasDepth ? 2 : 1;
     renderPassCreateInfo.subpassCount = 1;
     renderPassCreateInfo.pSubpasses = &subpassDescription;
-    renderPassCreateInfo.pAttachments = &attachmentDescription;
+    renderPassCreateInfo.pAttachments = attachmentDescriptions;
+    renderPassCreateInfo.dependencyCount = hasDepth ? 1 : 0;
+    renderPassCreateInfo.pDependencies = &subpassDependency;
 
     VkRenderPass result = nullptr;
-    vkCreateRenderPass(device, &renderPassCreateInfo, nullptr,
+    vkCreateRenderPass(device, &renderPassCreateInfo, allocationCallbacks,
         &result);
 
     return result;
@@ -398,27 +643,31 @@ VkRenderPass CreateRenderPass(VkDevice device, VkFormat swapchainFormat)
 ///////////////////////////////////////////////////////////////////////////////
 void CreateFramebuffers(VkDevice device, VkRenderPass renderPass,
     const int width, const int height,
-    const int count, const VkImageView* imageViews, VkFramebuffer* framebuffers)
+    const int count, const VkImageView* imageViews, VkImageView depthView,
+    VkFramebuffer* framebuffers, const VkAllocationCallbacks* allocationCallbacks)
 {
     for (int i = 0; i < count; ++i)
     {
+        const VkImageView attachments[] = { imageViews[i], depthView };
+
         VkFramebufferCreateInfo framebufferCreateInfo = {};
         framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferCreateInfo.attachmentCount = 1;
-        framebufferCreateInfo.pAttachments = &imageViews[i];
+        framebufferCreateInfo.attachmentCount = depthView != VK_NULL_HANDLE ? 2 : 1;
+        framebufferCreateInfo.pAttachments = attachments;
         framebufferCreateInfo.height = height;
         framebufferCreateInfo.width = width;
         framebufferCreateInfo.layers = 1;
         framebufferCreateInfo.renderPass = renderPass;
 
-        vkCreateFramebuffer(device, &framebufferCreateInfo, nullptr,
+        vkCreateFramebuffer(device, &framebufferCreateInfo, allocationCallbacks,
             &framebuffers[i]);
     }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 void CreateSwapchainImageViews(VkDevice device, VkFormat format,
-    const int count, const VkImage* images, VkImageView* imageViews)
+    const int count, const VkImage* images, VkImageView* imageViews,
+    const VkAllocationCallbacks* allocationCallbacks)
 {
     for (int i = 0; i < count; ++i)
     {
@@ -431,42 +680,148 @@ void CreateSwapchainImageViews(VkDevice device, VkFormat format,
         imageViewCreateInfo.subresourceRange.layerCount = 1;
         imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 
-        vkCreateImageView(device, &imageViewCreateInfo, nullptr,
+        vkCreateImageView(device, &imageViewCreateInfo, allocationCallbacks,
             &imageViews[i]);
     }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+// Timestamps written per frame, in submission order
+enum TimestampQuery
+{
+    TQ_FrameBegin,
+    TQ_RenderBegin,
+    TQ_RenderEnd,
+    TQ_FrameEnd,
+    TQ_Count
+};
+
+///////////////////////////////////////////////////////////////////////////////
+void ResetAndBeginTimestamps(VkCommandBuffer commandBuffer, VkQueryPool queryPool)
+{
+    vkCmdResetQueryPool(commandBuffer, queryPool, 0, TQ_Count);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        queryPool, TQ_FrameBegin);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+const char* GetPresentModeName(const VkPresentModeKHR presentMode)
+{
+    switch (presentMode)
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+    case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+    case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+    default: return "UNKNOWN";
+    }
+}
+
+#ifdef _WIN32
+///////////////////////////////////////////////////////////////////////////////
+VkPresentModeKHR SelectPresentMode(const std::vector<VkPresentModeKHR>& presentModes,
+    const VkPresentModeKHR requestedMode, const bool uncapped)
+{
+    // Fallback order for each request, FIFO is required to be supported
+    // so every list ends with it
+    std::vector<VkPresentModeKHR> candidates;
+
+    if (uncapped)
+    {
+        candidates = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+    }
+    else
+    {
+        switch (requestedMode)
+        {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            // Not FIFO_RELAXED, it is still paced by vertical blank
+            candidates = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+            break;
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            candidates = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+            break;
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            candidates = { VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+            break;
+        default:
+            break;
+        }
+    }
+
+    candidates.push_back(VK_PRESENT_MODE_FIFO_KHR);
+
+    for (const auto candidate : candidates)
+    {
+        if (std::find(presentModes.begin(), presentModes.end(), candidate) != presentModes.end())
+        {
+            if (uncapped && candidate == VK_PRESENT_MODE_FIFO_KHR)
+            {
+                // The run measures the refresh rate, not the frame rate
+                DebugPrint("No uncapped present mode supported, using %s - "
+                    "frame times are bound by vertical blank\n",
+                    GetPresentModeName(candidate));
+            }
+            else if (candidate != requestedMode && !uncapped)
+            {
+                DebugPrint("Present mode %s not supported, using %s instead\n",
+                    GetPresentModeName(requestedMode), GetPresentModeName(candidate));
+            }
+
+            return candidate;
+        }
+    }
+
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Returns VK_NULL_HANDLE without creating anything if the surface has a
+* size of zero, which happens while the window is minimized. Otherwise,
+* oldSwapchain is retired, but must still be destroyed by the caller.
+*/
 VkSwapchainKHR CreateSwapchain(VkPhysicalDevice physicalDevice, VkDevice device,
     VkSurfaceKHR surface, const int surfaceWidth, const int surfaceHeight,
-    const int backbufferCount, VulkanSample::ImportTable* importTable,
-    VkFormat* swapchainFormat)
+    const VkPresentModeKHR presentMode, VkSwapchainKHR oldSwapchain,
+    VulkanSample::ImportTable* importTable, VkFormat* swapchainFormat,
+    VkExtent2D* swapchainExtent, const VkAllocationCallbacks* allocationCallbacks)
 {
     VkSurfaceCapabilitiesKHR surfaceCapabilities;
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice,
         surface, &surfaceCapabilities);
 
-    uint32_t presentModeCount;
-    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice,
-        surface, &presentModeCount, nullptr);
-
-    std::vector<VkPresentModeKHR> presentModes{ presentModeCount };
+    VkExtent2D swapChainSize = surfaceCapabilities.currentExtent;
 
-    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice,
-        surface, &presentModeCount, presentModes.data());
+    // 0xFFFFFFFF means the surface size is determined by the swapchain, so
+    // we use the window size
+    if (swapChainSize.width == 0xFFFFFFFF)
+    {
+        swapChainSize.width = std::min(std::max(static_cast<uint32_t> (surfaceWidth),
+            surfaceCapabilities.minImageExtent.width),
+            surfaceCapabilities.maxImageExtent.width);
+        swapChainSize.height = std::min(std::max(static_cast<uint32_t> (surfaceHeight),
+            surfaceCapabilities.minImageExtent.height),
+            surfaceCapabilities.maxImageExtent.height);
+    }
 
-    VkExtent2D swapChainSize = {};
-    swapChainSize = surfaceCapabilities.currentExtent;
-    assert(static_cast<int> (swapChainSize.width) == surfaceWidth);
-    assert(static_cast<int> (swapChainSize.height) == surfaceHeight);
+    if (swapChainSize.width == 0 || swapChainSize.height == 0)
+    {
+        return VK_NULL_HANDLE;
+    }
 
-    uint32_t swapChainImageCount = backbufferCount;
-    assert(swapChainImageCount >= surfaceCapabilities.minImageCount);
+    // The number of images is up to the driver, we only ask for one more
+    // than the minimum so acquire doesn't have to wait for the presentation
+    // engine. How far the CPU can run ahead is controlled by the frames in
+    // flight instead.
+    uint32_t swapChainImageCount = surfaceCapabilities.minImageCount + 1;
 
     // 0 indicates unlimited number of images
     if (surfaceCapabilities.maxImageCount != 0)
     {
-        assert(swapChainImageCount < surfaceCapabilities.maxImageCount);
+        swapChainImageCount = std::min(swapChainImageCount,
+            surfaceCapabilities.maxImageCount);
     }
 
     VkSurfaceTransformFlagBitsKHR surfaceTransformFlags;
@@ -494,26 +849,79 @@ VkSwapchainKHR CreateSwapchain(VkPhysicalDevice physicalDevice, VkDevice device,
     swapchainCreateInfo.pQueueFamilyIndices = nullptr;
     swapchainCreateInfo.queueFamilyIndexCount = 0;
     swapchainCreateInfo.clipped = VK_TRUE;
-    swapchainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+    swapchainCreateInfo.oldSwapchain = oldSwapchain;
     swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapchainCreateInfo.imageExtent = swapChainSize;
     swapchainCreateInfo.imageArrayLayers = 1;
-    swapchainCreateInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    swapchainCreateInfo.presentMode = presentMode;
 
     VkSwapchainKHR swapchain;
     vkCreateSwapchainKHR(device, &swapchainCreateInfo,
-        nullptr, &swapchain);
+        allocationCallbacks, &swapchain);
 
     if (swapchainFormat)
     {
         *swapchainFormat = swapchainFormatColorSpace.format;
     }
 
+    if (swapchainExtent)
+    {
+        *swapchainExtent = swapChainSize;
+    }
+
     return swapchain;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-VkSurfaceKHR CreateSurface(VkInstance instance, HWND hwnd)
+bool CreateHeadlessImages(DeviceMemoryAllocator& allocator,
+    VkDevice device, VkFormat format, const int width, const int height,
+    const int count, VkImage* images, DeviceMemoryAllocation* imageMemory,
+    const VkAllocationCallbacks* allocationCallbacks)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        VkImageCreateInfo imageCreateInfo = {};
+        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format = format;
+        imageCreateInfo.extent.width = width;
+        imageCreateInfo.extent.height = height;
+        imageCreateInfo.extent.depth = 1;
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        // Transfer source so the results can be copied out for inspection
+        imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        vkCreateImage(device, &imageCreateInfo, allocationCallbacks, &images[i]);
+
+        // Render targets are the typical case for dedicated allocations
+        if (!allocator.AllocateForImage(images[i], MU_GpuOnly, &imageMemory[i]))
+        {
+            for (int j = 0; j <= i; ++j)
+            {
+                vkDestroyImage(device, images[j], allocationCallbacks);
+                images[j] = VK_NULL_HANDLE;
+                allocator.Free(imageMemory[j]);
+            }
+
+            return false;
+        }
+
+        vkBindImageMemory(device, images[i], imageMemory[i].memory,
+            imageMemory[i].offset);
+    }
+
+    return true;
+}
+
+#ifdef _WIN32
+///////////////////////////////////////////////////////////////////////////////
+VkSurfaceKHR CreateSurface(VkInstance instance, HWND hwnd,
+    const VkAllocationCallbacks* allocationCallbacks)
 {
     VkWin32SurfaceCreateInfoKHR win32surfaceCreateInfo = {};
     win32surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
@@ -521,15 +929,17 @@ VkSurfaceKHR CreateSurface(VkInstance instance, HWND hwnd)
     win32surfaceCreateInfo.hinstance = ::GetModuleHandle(nullptr);
 
     VkSurfaceKHR surface = nullptr;
-    vkCreateWin32SurfaceKHR(instance, &win32surfaceCreateInfo, nullptr,
+    vkCreateWin32SurfaceKHR(instance, &win32surfaceCreateInfo, allocationCallbacks,
         &surface);
 
     return surface;
 }
+#endif
 
 #ifdef _DEBUG
 ///////////////////////////////////////////////////////////////////////////////
-VkDebugReportCallbackEXT SetupDebugCallback(VkInstance instance, VulkanSample::ImportTable* importTable)
+VkDebugReportCallbackEXT SetupDebugCallback(VkInstance instance, VulkanSample::ImportTable* importTable,
+    const VkAllocationCallbacks* allocationCallbacks)
 {
     if (importTable->vkCreateDebugReportCallbackEXT)
     {
@@ -542,7 +952,8 @@ VkDebugReportCallbackEXT SetupDebugCallback(VkInstance instance, VulkanSample::I
         callbackCreateInfo.pfnCallback = &DebugReportCallback;
 
         VkDebugReportCallbackEXT callback;
-        importTable->vkCreateDebugReportCallbackEXT(instance, &callbackCreateInfo, nullptr, &callback);
+        importTable->vkCreateDebugReportCallbackEXT(instance, &callbackCreateInfo,
+            allocationCallbacks, &callback);
         return callback;
     }
     else
@@ -553,11 +964,12 @@ VkDebugReportCallbackEXT SetupDebugCallback(VkInstance instance, VulkanSample::I
 
 ///////////////////////////////////////////////////////////////////////////////
 void CleanupDebugCallback(VkInstance instance, VkDebugReportCallbackEXT callback,
-    VulkanSample::ImportTable* importTable)
+    VulkanSample::ImportTable* importTable,
+    const VkAllocationCallbacks* allocationCallbacks)
 {
     if (importTable->vkDestroyDebugReportCallbackEXT)
     {
-        importTable->vkDestroyDebugReportCallbackEXT(instance, callback, nullptr);
+        importTable->vkDestroyDebugReportCallbackEXT(instance, callback, allocationCallbacks);
     }
 }
 #endif
@@ -565,250 +977,1417 @@ void CleanupDebugCallback(VkInstance instance, VkDebugReportCallbackEXT callback
 }   // namespace
 
 ///////////////////////////////////////////////////////////////////////////////
-VulkanSample::VulkanSample()
+VulkanSample::VulkanSample(const SampleOptions& options)
 {
-    instance_ = CreateInstance();
+    phaseStart_ = std::chrono::high_resolution_clock::now();
+
+#ifdef _WIN32
+    headless_ = options.headless;
+#else
+    // Window support is Windows-only at the moment
+    headless_ = true;
+#endif
+
+    // The host allocator has to outlive every object created with its
+    // callbacks, so it is set up before the instance and torn down last
+    if (options.hostAllocator)
+    {
+        hostAllocator_.reset(new HostAllocator);
+        allocationCallbacks_ = hostAllocator_->GetCallbacks();
+    }
+
+    instance_ = CreateInstance(headless_, allocationCallbacks_);
     if (instance_ == VK_NULL_HANDLE)
     {
         // just bail out if the user does not have a compatible Vulkan driver
         return;
     }
 
+    EndStartupPhase("createInstance");
+
     VkPhysicalDevice physicalDevice;
-    CreateDeviceAndQueue(instance_, &device_, &queue_, &queueFamilyIndex_,
-        &physicalDevice);
+    bool memoryBudgetEnabled = false;
+    if (!CreateDeviceAndQueue(instance_, headless_, options.transferQueue,
+        &device_, &queue_, &queueFamilyIndex_,
+        &transferQueue_, &transferQueueFamilyIndex_,
+        &physicalDevice, &memoryBudgetEnabled, allocationCallbacks_))
+    {
+        // device_ stays VK_NULL_HANDLE, same as without a compatible driver
+        return;
+    }
+
     physicalDevice_ = physicalDevice;
 
+    deviceMemoryProperties_.reset(new DeviceMemoryProperties{ physicalDevice_,
+        memoryBudgetEnabled });
+    deviceMemoryAllocator_.reset(new DeviceMemoryAllocator{ physicalDevice_, device_,
+        *deviceMemoryProperties_, allocationCallbacks_ });
+
+    // Through the small BAR window, direct writes would compete with the
+    // driver for it
+    if (deviceMemoryProperties_->GetHostVisibleDeviceLocalSize() > SmallBarSize)
+    {
+        directUploadLimit_ = options.directUploadLimit;
+    }
+
+    if (options.depthBuffer)
+    {
+        depthFormat_ = SelectDepthFormat(physicalDevice_);
+    }
+
+    EndStartupPhase("createDevice");
+
     importTable_.reset(new ImportTable{ instance_, device_ });
 
 #ifdef _DEBUG
-    debugCallback_ = SetupDebugCallback(instance_, importTable_.get());
+    debugCallback_ = SetupDebugCallback(instance_, importTable_.get(),
+        allocationCallbacks_);
 #endif
 
-    window_.reset(new Window{ "Hello Vulkan", 1280, 720 });
+    VkFormat swapchainFormat = VK_FORMAT_UNDEFINED;
 
-    surface_ = CreateSurface(instance_, window_->GetHWND());
+    if (headless_)
+    {
+        window_.reset(new HeadlessWindow{ options.width, options.height });
+        renderExtent_.width = options.width;
+        renderExtent_.height = options.height;
+
+        // One image per frame in flight, so waiting for the frame also protects
+        // the image from being overwritten while it's still in use
+        swapchainImages_.resize(options.framesInFlight);
+        headlessImageMemory_.resize(options.framesInFlight);
+
+        swapchainFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        if (!CreateHeadlessImages(*deviceMemoryAllocator_, device_, swapchainFormat,
+            renderExtent_.width, renderExtent_.height,
+            static_cast<int> (swapchainImages_.size()),
+            swapchainImages_.data(), headlessImageMemory_.data(),
+            allocationCallbacks_))
+        {
+            DebugPrint("Could not allocate the %dx%d render targets\n",
+                options.width, options.height);
 
-    VkBool32 presentSupported;
-    vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice,
-        0, surface_, &presentSupported);
-    assert(presentSupported);
+            // Leaves the sample uninitialized, see IsInitialized()
+#ifdef _DEBUG
+            CleanupDebugCallback(instance_, debugCallback_, importTable_.get(),
+                allocationCallbacks_);
+#endif
+            deviceMemoryAllocator_.reset();
+            deviceMemoryProperties_.reset();
+            vkDestroyDevice(device_, allocationCallbacks_);
+            device_ = VK_NULL_HANDLE;
+            return;
+        }
 
-    VkFormat swapchainFormat = VK_FORMAT_UNDEFINED;
-    swapchain_ = CreateSwapchain(physicalDevice, device_, surface_,
-        window_->GetWidth(), window_->GetHeight(), QUEUE_SLOT_COUNT,
-        importTable_.get(), &swapchainFormat);
+        renderPass_ = CreateRenderPass(device_, swapchainFormat,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, depthFormat_, allocationCallbacks_);
+    }
+#ifdef _WIN32
+    else
+    {
+        auto window = new Window{ "Hello Vulkan", options.width, options.height };
+        window_.reset(window);
 
-    assert(swapchain_);
+        surface_ = CreateSurface(instance_, window->GetHWND(), allocationCallbacks_);
 
-    uint32_t swapchainImageCount = 0;
-    vkGetSwapchainImagesKHR(device_, swapchain_,
-        &swapchainImageCount, nullptr);
-    assert(static_cast<int> (swapchainImageCount) == QUEUE_SLOT_COUNT);
+        VkBool32 presentSupported;
+        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice,
+            queueFamilyIndex_, surface_, &presentSupported);
+        assert(presentSupported);
 
-    vkGetSwapchainImagesKHR(device_, swapchain_,
-        &swapchainImageCount, swapchainImages_);
+        uint32_t presentModeCount;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice,
+            surface_, &presentModeCount, nullptr);
+
+        std::vector<VkPresentModeKHR> presentModes(presentModeCount);
+
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice,
+            surface_, &presentModeCount, presentModes.data());
 
-    renderPass_ = CreateRenderPass(device_, swapchainFormat);
+        presentMode_ = SelectPresentMode(presentModes,
+            options.presentMode, options.uncapped);
 
-    CreateSwapchainImageViews(device_, swapchainFormat,
-        QUEUE_SLOT_COUNT, swapchainImages_, swapChainImageViews_);
-    CreateFramebuffers(device_, renderPass_, window_->GetWidth(), window_->GetHeight(),
-        QUEUE_SLOT_COUNT, swapChainImageViews_, framebuffer_);
+        swapchain_ = CreateSwapchain(physicalDevice, device_, surface_,
+            window_->GetWidth(), window_->GetHeight(), presentMode_,
+            VK_NULL_HANDLE, importTable_.get(), &swapchainFormat, &renderExtent_,
+            allocationCallbacks_);
 
+        assert(swapchain_);
+
+        swapchainWindowWidth_ = window_->GetWidth();
+        swapchainWindowHeight_ = window_->GetHeight();
+
+        GetSwapchainImages();
+
+        renderPass_ = CreateRenderPass(device_, swapchainFormat,
+            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, depthFormat_, allocationCallbacks_);
+    }
+#endif
+
+    swapchainFormat_ = swapchainFormat;
+
+    if (!CreateBackbufferResources())
+    {
+        // Nothing has been built on the render pass yet, so it can still
+        // lose its depth attachment
+        DebugPrint("Could not allocate the depth buffer, rendering without one\n");
+
+        vkDestroyRenderPass(device_, renderPass_, allocationCallbacks_);
+        depthFormat_ = VK_FORMAT_UNDEFINED;
+        renderPass_ = CreateRenderPass(device_, swapchainFormat_,
+            headless_ ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            depthFormat_, allocationCallbacks_);
+
+        const bool created = CreateBackbufferResources();
+        assert(created);
+        (void)created;
+    }
+
+    EndStartupPhase("createSwapchain");
+
+    // This pool only holds long-lived command buffers - the setup buffer
+    // and the pre-recorded ones - per-frame buffers come from the
+    // per-frame command allocators
     VkCommandPoolCreateInfo commandPoolCreateInfo = {};
     commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex_;
-    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-    vkCreateCommandPool(device_, &commandPoolCreateInfo, nullptr,
+    vkCreateCommandPool(device_, &commandPoolCreateInfo, allocationCallbacks_,
         &commandPool_);
 
     VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
     commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferAllocateInfo.commandBufferCount = QUEUE_SLOT_COUNT + 1;
+    commandBufferAllocateInfo.commandBufferCount = 1;
     commandBufferAllocateInfo.commandPool = commandPool_;
     commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 
-    VkCommandBuffer commandBuffers[QUEUE_SLOT_COUNT + 1];
-
     vkAllocateCommandBuffers(device_, &commandBufferAllocateInfo,
-        commandBuffers);
+        &setupCommandBuffer_);
 
-    for (int i = 0; i < QUEUE_SLOT_COUNT; ++i)
+    if (transferQueue_ != VK_NULL_HANDLE)
     {
-        commandBuffers_[i] = commandBuffers[i];
-    }
+        // The setup uploads run here, and the setup command buffer only
+        // takes the resources over
+        commandPoolCreateInfo.queueFamilyIndex = transferQueueFamilyIndex_;
+        vkCreateCommandPool(device_, &commandPoolCreateInfo, allocationCallbacks_,
+            &transferCommandPool_);
 
-    setupCommandBuffer_ = commandBuffers[QUEUE_SLOT_COUNT];
+        commandBufferAllocateInfo.commandPool = transferCommandPool_;
+        vkAllocateCommandBuffers(device_, &commandBufferAllocateInfo,
+            &uploadCommandBuffer_);
 
-    for (int i = 0; i < QUEUE_SLOT_COUNT; ++i)
-    {
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        vkCreateSemaphore(device_, &semaphoreCreateInfo, allocationCallbacks_,
+            &uploadCompleteSemaphore_);
+
+        // Polled by Run(), the graphics queue only takes the resources over
+        // once the upload is done
         VkFenceCreateInfo fenceCreateInfo = {};
         fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        // We need this so we can wait for them on the first try
-        fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-        vkCreateFence(device_, &fenceCreateInfo, nullptr, &frameFences_[i]);
+        vkCreateFence(device_, &fenceCreateInfo, allocationCallbacks_,
+            &uploadFence_);
     }
-}
 
-///////////////////////////////////////////////////////////////////////////////
-VulkanSample::~VulkanSample()
-{
-}
+    assert(options.framesInFlight > 0);
+    frames_.resize(options.framesInFlight);
 
-///////////////////////////////////////////////////////////////////////////////
-void VulkanSample::ShutdownImpl()
-{
-    for (int i = 0; i < QUEUE_SLOT_COUNT; ++i)
+    if (options.workerThreadCount > 0)
     {
-        vkDestroyFence(device_, frameFences_[i], nullptr);
+        workerPool_.reset(new WorkerPool{ options.workerThreadCount });
     }
 
-    vkDestroyRenderPass(device_, renderPass_, nullptr);
+    // Command pools must not be used from more than one thread at a time,
+    // so there is one allocator for the thread calling Run() and one for
+    // every worker, per frame slot
+    threadCount_ = options.workerThreadCount + 1;
+    commandAllocators_.resize(frames_.size() * threadCount_);
 
-    for (int i = 0; i < QUEUE_SLOT_COUNT; ++i)
+    for (auto& commandAllocator : commandAllocators_)
     {
-        vkDestroyFramebuffer(device_, framebuffer_[i], nullptr);
-        vkDestroyImageView(device_, swapChainImageViews_[i], nullptr);
+        commandAllocator.reset(new CommandAllocator{ device_, queueFamilyIndex_,
+            allocationCallbacks_ });
     }
 
-    vkDestroyCommandPool(device_, commandPool_, nullptr);
+    recordOnce_ = options.recordOnce;
 
-    vkDestroySwapchainKHR(device_, swapchain_, nullptr);
-    vkDestroySurfaceKHR(instance_, surface_, nullptr);
-
-#ifdef _DEBUG
-    CleanupDebugCallback(instance_, debugCallback_, importTable_.get());
-#endif
+    if (recordOnce_)
+    {
+        // One pre-recorded command buffer per back buffer, as the
+        // framebuffer is baked into the render pass begin. They are
+        // allocated when first recorded.
+        staticCommandBuffers_.resize(swapchainImages_.size());
+    }
 
-    vkDestroyDevice(device_, nullptr);
-    vkDestroyInstance(instance_, nullptr);
-}
+    frameScheduler_.reset(new FrameScheduler{ device_, options.framesInFlight,
+        allocationCallbacks_ });
+    std::vector<uint32_t> stagingQueueFamilies(1, queueFamilyIndex_);
 
-///////////////////////////////////////////////////////////////////////////////
-void VulkanSample::Run(const int frameCount)
-{
-    if (IsInitialized() == false)
+    if (transferQueue_ != VK_NULL_HANDLE)
     {
-        // just bail out if the user does not have a compatible Vulkan driver
-        return;
+        stagingQueueFamilies.push_back(transferQueueFamilyIndex_);
     }
 
-    vkResetFences(device_, 1, &frameFences_[0]);
+    stagingRing_.reset(new StagingRing{ physicalDevice_, device_,
+        *deviceMemoryAllocator_, *frameScheduler_, options.stagingBufferSize,
+        allocationCallbacks_, stagingQueueFamilies });
+    uploadBatcher_.reset(new UploadBatcher{ *deviceMemoryAllocator_, *stagingRing_ });
+    deletionQueue_.reset(new DeferredDeletionQueue{ device_,
+        *deviceMemoryAllocator_, *frameScheduler_, allocationCallbacks_ });
+    defragmenter_.reset(new DeviceMemoryDefragmenter{ device_,
+        *deviceMemoryAllocator_, options.defragmentationBudget, 0.5f,
+        allocationCallbacks_ });
+    defragment_ = options.defragmentationBudget > 0;
+
+    for (auto& frame : frames_)
     {
-        VkCommandBufferBeginInfo beginInfo = {};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-        vkBeginCommandBuffer(setupCommandBuffer_, &beginInfo);
-
-        InitializeImpl(setupCommandBuffer_);
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        vkEndCommandBuffer(setupCommandBuffer_);
-
-        VkSubmitInfo submitInfo = {};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &setupCommandBuffer_;
-        vkQueueSubmit(queue_, 1, &submitInfo, frameFences_[0]);
+        vkCreateSemaphore(device_, &semaphoreCreateInfo,
+            allocationCallbacks_, &frame.imageAcquiredSemaphore);
     }
 
-    vkWaitForFences(device_, 1, &frameFences_[0], VK_TRUE, UINT64_MAX);
+    // Timestamps are optional, only use them if the queue supports them
+    VkPhysicalDeviceProperties physicalDeviceProperties = {};
+    vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
 
-    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
-    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    uint32_t queueFamilyPropertyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice,
+        &queueFamilyPropertyCount, nullptr);
 
-    VkSemaphore imageAcquiredSemaphore;
-    vkCreateSemaphore(device_, &semaphoreCreateInfo,
-        nullptr, &imageAcquiredSemaphore);
+    std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyPropertyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice,
+        &queueFamilyPropertyCount, queueFamilyProperties.data());
 
-    VkSemaphore renderingCompleteSemaphore;
-    vkCreateSemaphore(device_, &semaphoreCreateInfo,
-        nullptr, &renderingCompleteSemaphore);
-
-    for (int i = 0; i < frameCount; ++i)
+    if (queueFamilyProperties[queueFamilyIndex_].timestampValidBits > 0)
     {
-        vkAcquireNextImageKHR(
-            device_, swapchain_, UINT64_MAX, imageAcquiredSemaphore,
-            VK_NULL_HANDLE, &currentBackBuffer_);
+        timestampPeriod_ = physicalDeviceProperties.limits.timestampPeriod;
 
-        vkWaitForFences(device_, 1, &frameFences_[currentBackBuffer_], VK_TRUE,
-            UINT64_MAX);
-        vkResetFences(device_, 1, &frameFences_[currentBackBuffer_]);
+        for (auto& frame : frames_)
+        {
+            VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+            queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolCreateInfo.queryCount = TQ_Count;
 
-        VkCommandBufferBeginInfo beginInfo = {};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        
-        vkBeginCommandBuffer(commandBuffers_[currentBackBuffer_], &beginInfo);
+            vkCreateQueryPool(device_, &queryPoolCreateInfo, allocationCallbacks_,
+                &frame.timestampQueryPool);
+        }
+    }
 
-        VkRenderPassBeginInfo renderPassBeginInfo = {};
-        renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassBeginInfo.framebuffer = framebuffer_[currentBackBuffer_];
-        renderPassBeginInfo.renderArea.extent.width = window_->GetWidth();
-        renderPassBeginInfo.renderArea.extent.height = window_->GetHeight();
-        renderPassBeginInfo.renderPass = renderPass_;
+    EndStartupPhase("createFrameResources");
+}
 
-        VkClearValue clearValue = {};
+///////////////////////////////////////////////////////////////////////////////
+VulkanSample::~VulkanSample()
+{
+    if (!IsInitialized())
+    {
+        // The constructor gave up after creating the instance at most
+        if (instance_ != VK_NULL_HANDLE)
+        {
+            vkDestroyInstance(instance_, allocationCallbacks_);
+        }
 
-        clearValue.color.float32[0] = 0.042f;
-        clearValue.color.float32[1] = 0.042f;
-        clearValue.color.float32[2] = 0.042f;
-        clearValue.color.float32[3] = 1.0f;
+        return;
+    }
 
-        renderPassBeginInfo.pClearValues = &clearValue;
-        renderPassBeginInfo.clearValueCount = 1;
+    // The derived class is gone by now, and its UniqueHandles are in the
+    // deletion queue. Run() waited for all frames, but it may not have
+    // been called at all.
+    vkDeviceWaitIdle(device_);
+    deletionQueue_->Flush();
 
-        vkCmdBeginRenderPass(commandBuffers_[currentBackBuffer_],
-            &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    for (auto& frame : frames_)
+    {
+        vkDestroySemaphore(device_, frame.imageAcquiredSemaphore, allocationCallbacks_);
+        vkDestroyQueryPool(device_, frame.timestampQueryPool, allocationCallbacks_);
+    }
 
-        RenderImpl(commandBuffers_[currentBackBuffer_]);
+    vkDestroyRenderPass(device_, renderPass_, allocationCallbacks_);
 
-        vkCmdEndRenderPass(commandBuffers_[currentBackBuffer_]);
-        vkEndCommandBuffer(commandBuffers_[currentBackBuffer_]);
+    // Empty if RecreateSwapchain() could not replace them
+    for (std::size_t i = 0; i < framebuffer_.size(); ++i)
+    {
+        vkDestroyFramebuffer(device_, framebuffer_[i], allocationCallbacks_);
+        vkDestroyImageView(device_, swapChainImageViews_[i], allocationCallbacks_);
+    }
+
+    for (auto semaphore : renderingCompleteSemaphores_)
+    {
+        vkDestroySemaphore(device_, semaphore, allocationCallbacks_);
+    }
+
+    transientAttachments_.reset();
+
+    vkDestroyCommandPool(device_, commandPool_, allocationCallbacks_);
+
+    if (transferQueue_ != VK_NULL_HANDLE)
+    {
+        vkDestroyCommandPool(device_, transferCommandPool_, allocationCallbacks_);
+        vkDestroySemaphore(device_, uploadCompleteSemaphore_, allocationCallbacks_);
+        vkDestroyFence(device_, uploadFence_, allocationCallbacks_);
+    }
+
+    workerPool_.reset();
+    commandAllocators_.clear();
+
+    if (headless_)
+    {
+        for (std::size_t i = 0; i < swapchainImages_.size(); ++i)
+        {
+            vkDestroyImage(device_, swapchainImages_[i], allocationCallbacks_);
+            deviceMemoryAllocator_->Free(headlessImageMemory_[i]);
+        }
+    }
+    else
+    {
+        vkDestroySwapchainKHR(device_, swapchain_, allocationCallbacks_);
+        vkDestroySurfaceKHR(instance_, surface_, allocationCallbacks_);
+    }
+
+    deletionQueue_.reset();
+    defragmenter_.reset();
+    uploadBatcher_.reset();
+    stagingRing_.reset();
+    frameScheduler_.reset();
+
+    // Everything allocated by the sample must be gone by now
+    deviceMemoryAllocator_->ReportLeaks();
+    deviceMemoryAllocator_.reset();
+    deviceMemoryProperties_.reset();
+
+#ifdef _DEBUG
+    CleanupDebugCallback(instance_, debugCallback_, importTable_.get(),
+        allocationCallbacks_);
+#endif
+
+    vkDestroyDevice(device_, allocationCallbacks_);
+    vkDestroyInstance(instance_, allocationCallbacks_);
+
+    hostAllocator_.reset();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool VulkanSample::Run(const int frameCount)
+{
+    if (IsInitialized() == false)
+    {
+        // just bail out if the user does not have a compatible Vulkan driver
+        return false;
+    }
+
+    {
+        phaseStart_ = std::chrono::high_resolution_clock::now();
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        const bool transferUpload = transferQueue_ != VK_NULL_HANDLE;
+        const VkCommandBuffer uploadCommandBuffer = transferUpload
+            ? uploadCommandBuffer_ : setupCommandBuffer_;
+
+        vkBeginCommandBuffer(setupCommandBuffer_, &beginInfo);
+
+        if (transferUpload)
+        {
+            vkBeginCommandBuffer(uploadCommandBuffer_, &beginInfo);
+        }
+
+        // Lets InitializeImpl() pick placeholders
+        uploadPending_ = transferUpload;
+
+        if (!InitializeImpl(uploadCommandBuffer))
+        {
+            // Nothing was submitted, the destructor releases whatever was
+            // created so far
+            DebugPrint("Could not create the resources of the sample\n");
+
+            uploadBatcher_->Clear();
+            vkEndCommandBuffer(setupCommandBuffer_);
+
+            if (transferUpload)
+            {
+                vkEndCommandBuffer(uploadCommandBuffer_);
+            }
+
+            uploadPending_ = false;
+            return false;
+        }
+
+        uploadBatcher_->RecordCopies(uploadCommandBuffer);
+        RecordUploadBarriers(uploadCommandBuffer, false);
+        vkEndCommandBuffer(setupCommandBuffer_);
+
+        // Uploads written by InitializeImpl()
+        deviceMemoryAllocator_->FlushDirtyRanges();
+
+        // The setup work is tracked like any other frame
+        const uint64_t setupFrame = frameScheduler_->BeginFrame();
+        const VkSemaphore timelineSemaphore = frameScheduler_->GetTimelineSemaphore();
+
+        if (transferUpload)
+        {
+            vkEndCommandBuffer(uploadCommandBuffer_);
+
+            // Nothing waits for this on the GPU yet. The graphics queue
+            // acquires the resources in the first frame which starts after
+            // the fence is signaled, until then the sample renders
+            // placeholders.
+            VkSubmitInfo uploadSubmitInfo = {};
+            uploadSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            uploadSubmitInfo.commandBufferCount = 1;
+            uploadSubmitInfo.pCommandBuffers = &uploadCommandBuffer_;
+            uploadSubmitInfo.signalSemaphoreCount = 1;
+            uploadSubmitInfo.pSignalSemaphores = &uploadCompleteSemaphore_;
+
+            vkResetFences(device_, 1, &uploadFence_);
+            vkQueueSubmit(transferQueue_, 1, &uploadSubmitInfo, uploadFence_);
+        }
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+        timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineSubmitInfo.signalSemaphoreValueCount = 1;
+        timelineSubmitInfo.pSignalSemaphoreValues = &setupFrame;
 
-        // Submit rendering work to the graphics queue
-        const VkPipelineStageFlags waitDstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
         VkSubmitInfo submitInfo = {};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = &imageAcquiredSemaphore;
-        submitInfo.pWaitDstStageMask = &waitDstStageMask;
+        submitInfo.pNext = &timelineSubmitInfo;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffers_[currentBackBuffer_];
+        submitInfo.pCommandBuffers = &setupCommandBuffer_;
         submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = &renderingCompleteSemaphore;
+        submitInfo.pSignalSemaphores = &timelineSemaphore;
+
         vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE);
 
-        // Submit present operation to present queue
-        VkPresentInfoKHR presentInfo = {};
-        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = &renderingCompleteSemaphore;
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = &swapchain_;
-        presentInfo.pImageIndices = &currentBackBuffer_;
-        vkQueuePresentKHR(queue_, &presentInfo);
-
-        vkQueueSubmit(queue_, 0, nullptr, frameFences_[currentBackBuffer_]);
-    };
+        // The staging regions of a transfer upload are read until the fence
+        // is signaled, so they are held for the frame which acquires the
+        // resources - along with the setup regions, which are mixed in
+        if (uploadPending_)
+        {
+            stagingRing_->Hold();
+        }
+        else
+        {
+            stagingRing_->Submit(setupFrame);
+        }
+
+        // No wait here, the first frame is recorded right away and queued
+        // behind the setup work
+        EndStartupPhase("initialize");
+    }
+
+    const auto runStart = std::chrono::high_resolution_clock::now();
+
+    int renderedFrameCount = 0;
+
+    while (renderedFrameCount < frameCount)
+    {
+        const auto frameStart = std::chrono::high_resolution_clock::now();
+
+        window_->ProcessEvents();
+
+        if (window_->IsClosed())
+        {
+            break;
+        }
+
+        if (!headless_)
+        {
+            if (swapchainWindowWidth_ != window_->GetWidth() ||
+                swapchainWindowHeight_ != window_->GetHeight())
+            {
+                swapchainOutOfDate_ = true;
+            }
+
+            if (swapchainOutOfDate_)
+            {
+                if (!RecreateSwapchain())
+                {
+                    // Minimized, there is nothing to render to - or no
+                    // memory for the depth buffer right now
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    continue;
+                }
+            }
+        }
+
+        // Blocks until the GPU is done with the frame which used this slot
+        // before, so we can reuse its semaphores and command buffer
+        const uint64_t frameValue = frameScheduler_->BeginFrame();
+        currentFrameSlot_ = frameScheduler_->GetFrameSlot();
+        auto& frame = frames_[currentFrameSlot_];
+
+        deletionQueue_->Collect();
+
+        // All command buffers allocated for this slot are done as well, so
+        // recycle them wholesale
+        for (int j = 0; j < threadCount_; ++j)
+        {
+            GetCommandAllocator(currentFrameSlot_, j).Reset();
+        }
+
+        frameCommandBuffers_.clear();
+
+        // No Vulkan call is in flight on any thread between frames, so the
+        // driver's per-call scratch memory can be recycled
+        if (hostAllocator_)
+        {
+            hostAllocator_->BeginFrame();
+        }
+
+        // The previous frame in this slot has retired, so its timestamps
+        // are available without waiting
+        ReadTimestamps(frame);
+
+        if (headless_)
+        {
+            // Without a swapchain, each frame slot owns one image
+            currentBackBuffer_ = currentFrameSlot_;
+        }
+        else
+        {
+            const VkResult acquireResult = vkAcquireNextImageKHR(
+                device_, swapchain_, UINT64_MAX, frame.imageAcquiredSemaphore,
+                VK_NULL_HANDLE, &currentBackBuffer_);
+
+            if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+            {
+                // No image was acquired, so the semaphore stays unsignaled.
+                // The frame value must still be signaled, as the frame
+                // scheduler waits for it later.
+                swapchainOutOfDate_ = true;
+                SignalFrame(frameValue);
+                continue;
+            }
+            else if (acquireResult == VK_SUBOPTIMAL_KHR)
+            {
+                // The image is acquired and can be presented, recreate
+                // on the next frame
+                swapchainOutOfDate_ = true;
+            }
+        }
+
+        // Also only once the image is acquired, so the acquire barriers
+        // and the semaphore wait are not dropped with the frame
+        bool waitForUpload = false;
+
+        if (uploadPending_ &&
+            vkGetFenceStatus(device_, uploadFence_) == VK_SUCCESS)
+        {
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+            VkCommandBuffer acquireCommandBuffer = GetFrameCommandAllocator().Allocate();
+            vkBeginCommandBuffer(acquireCommandBuffer, &beginInfo);
+            RecordUploadBarriers(acquireCommandBuffer, true);
+            vkEndCommandBuffer(acquireCommandBuffer);
+
+            frameCommandBuffers_.push_back(acquireCommandBuffer);
+            waitForUpload = true;
+            uploadPending_ = false;
+
+            UploadsCompleteImpl();
+            InvalidateCommandBuffers();
+        }
+
+        // Only once the image is acquired - the moved resources are handed
+        // to the sample right away, so the copies must not be dropped.
+        // Resources still owned by the transfer queue can't be moved.
+        if (defragment_ && !uploadPending_ && defragmenter_->BeginFrame())
+        {
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+            VkCommandBuffer defragmentCommandBuffer = GetFrameCommandAllocator().Allocate();
+            vkBeginCommandBuffer(defragmentCommandBuffer, &beginInfo);
+            const int moveCount = defragmenter_->Record(defragmentCommandBuffer);
+            vkEndCommandBuffer(defragmentCommandBuffer);
+
+            frameCommandBuffers_.push_back(defragmentCommandBuffer);
+
+            if (moveCount > 0)
+            {
+                InvalidateCommandBuffers();
+            }
+        }
+
+        const auto recordStart = std::chrono::high_resolution_clock::now();
+
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkCommandBuffer epilogueCommandBuffer = VK_NULL_HANDLE;
+
+        if (recordOnce_)
+        {
+            auto& staticCommandBuffer = staticCommandBuffers_[currentBackBuffer_];
+
+            if (!staticCommandBuffer.valid)
+            {
+                // Can't free the command buffer while a previous frame is
+                // still executing it. Replacing it is cheap compared to
+                // giving the pool individually resettable buffers.
+                frameScheduler_->WaitForFrame(staticCommandBuffer.lastFrame);
+
+                if (staticCommandBuffer.commandBuffer != VK_NULL_HANDLE)
+                {
+                    vkFreeCommandBuffers(device_, commandPool_, 1,
+                        &staticCommandBuffer.commandBuffer);
+                }
+
+                VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+                commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                commandBufferAllocateInfo.commandBufferCount = 1;
+                commandBufferAllocateInfo.commandPool = commandPool_;
+                commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+                vkAllocateCommandBuffers(device_, &commandBufferAllocateInfo,
+                    &staticCommandBuffer.commandBuffer);
+
+                // Secondary command buffers are reset with their frame slot,
+                // so they can't be referenced from a pre-recorded buffer
+                RecordCommandBuffer(staticCommandBuffer.commandBuffer,
+                    currentBackBuffer_, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+                    false, VK_NULL_HANDLE);
+                staticCommandBuffer.valid = true;
+            }
+
+            staticCommandBuffer.lastFrame = frameValue;
+            commandBuffer = staticCommandBuffer.commandBuffer;
+
+            // The query pool belongs to the frame slot, not the back buffer,
+            // so the timestamps go into small per-frame command buffers
+            // around the pre-recorded one. Begin/end of rendering coincide
+            // with begin/end of the frame in this case.
+            if (frame.timestampQueryPool != VK_NULL_HANDLE)
+            {
+                VkCommandBufferBeginInfo beginInfo = {};
+                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+                VkCommandBuffer prologue = GetFrameCommandAllocator().Allocate();
+                vkBeginCommandBuffer(prologue, &beginInfo);
+                ResetAndBeginTimestamps(prologue, frame.timestampQueryPool);
+                vkCmdWriteTimestamp(prologue, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                    frame.timestampQueryPool, TQ_RenderBegin);
+                vkEndCommandBuffer(prologue);
+
+                frameCommandBuffers_.push_back(prologue);
+
+                epilogueCommandBuffer = GetFrameCommandAllocator().Allocate();
+                vkBeginCommandBuffer(epilogueCommandBuffer, &beginInfo);
+                vkCmdWriteTimestamp(epilogueCommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                    frame.timestampQueryPool, TQ_RenderEnd);
+                vkCmdWriteTimestamp(epilogueCommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                    frame.timestampQueryPool, TQ_FrameEnd);
+                vkEndCommandBuffer(epilogueCommandBuffer);
+            }
+        }
+        else
+        {
+            commandBuffer = GetFrameCommandAllocator().Allocate();
+
+            RecordCommandBuffer(commandBuffer, currentBackBuffer_,
+                VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                workerPool_ && GetRenderTaskCount() > 0,
+                frame.timestampQueryPool);
+        }
+
+        if (frame.timestampQueryPool != VK_NULL_HANDLE)
+        {
+            frame.timestampFrame = frameValue;
+        }
+
+        CpuFrameTiming cpuTiming;
+        cpuTiming.frame = frameValue;
+        cpuTiming.recordTime = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - recordStart).count();
+
+        // Buffers added by the sample go first, the render pass last
+        frameCommandBuffers_.push_back(commandBuffer);
+
+        if (epilogueCommandBuffer != VK_NULL_HANDLE)
+        {
+            frameCommandBuffers_.push_back(epilogueCommandBuffer);
+        }
+
+        // Everything the CPU wrote for this frame, in one flush
+        deviceMemoryAllocator_->FlushDirtyRanges();
+
+        // Submit rendering work to the graphics queue. The same submit
+        // signals the timeline with this frame's value, the value for the
+        // binary semaphore is ignored.
+        const VkSemaphore signalSemaphores[] = {
+            frameScheduler_->GetTimelineSemaphore(),
+            headless_ ? VK_NULL_HANDLE : renderingCompleteSemaphores_[currentBackBuffer_]
+        };
+        const uint64_t signalValues[] = { frameValue, 0 };
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+        timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineSubmitInfo.signalSemaphoreValueCount = 2;
+        timelineSubmitInfo.pSignalSemaphoreValues = signalValues;
+
+        // The upload semaphore is already signaled, waiting on it only
+        // orders the acquire barriers after the release
+        VkSemaphore waitSemaphores[2];
+        VkPipelineStageFlags waitDstStageMasks[2];
+        uint32_t waitSemaphoreCount = 0;
+
+        if (!headless_)
+        {
+            waitSemaphores[waitSemaphoreCount] = frame.imageAcquiredSemaphore;
+            waitDstStageMasks[waitSemaphoreCount] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            ++waitSemaphoreCount;
+        }
+
+        if (waitForUpload)
+        {
+            waitSemaphores[waitSemaphoreCount] = uploadCompleteSemaphore_;
+            waitDstStageMasks[waitSemaphoreCount] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            ++waitSemaphoreCount;
+        }
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineSubmitInfo;
+        submitInfo.waitSemaphoreCount = waitSemaphoreCount;
+        submitInfo.pWaitSemaphores = waitSemaphores;
+        submitInfo.pWaitDstStageMask = waitDstStageMasks;
+        submitInfo.commandBufferCount = static_cast<uint32_t> (frameCommandBuffers_.size());
+        submitInfo.pCommandBuffers = frameCommandBuffers_.data();
+        submitInfo.signalSemaphoreCount = 2;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+
+        if (headless_)
+        {
+            // Nothing to present, only signal the timeline
+            submitInfo.signalSemaphoreCount = 1;
+            timelineSubmitInfo.signalSemaphoreValueCount = 1;
+        }
+
+        vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE);
+
+        // This frame waits for the upload, so it retires after it
+        if (waitForUpload)
+        {
+            stagingRing_->Release(frameValue);
+        }
+
+        stagingRing_->Submit(frameValue);
+
+        if (!headless_)
+        {
+            // Submit present operation to present queue
+            VkPresentInfoKHR presentInfo = {};
+            presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            presentInfo.waitSemaphoreCount = 1;
+            presentInfo.pWaitSemaphores = &renderingCompleteSemaphores_[currentBackBuffer_];
+            presentInfo.swapchainCount = 1;
+            presentInfo.pSwapchains = &swapchain_;
+            presentInfo.pImageIndices = &currentBackBuffer_;
+            const VkResult presentResult = vkQueuePresentKHR(queue_, &presentInfo);
+
+            if (presentResult == VK_ERROR_OUT_OF_DATE_KHR ||
+                presentResult == VK_SUBOPTIMAL_KHR)
+            {
+                swapchainOutOfDate_ = true;
+            }
+        }
+
+        cpuTiming.frameTime = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - frameStart).count();
+        cpuFrameTimings_.push_back(cpuTiming);
+
+        ++renderedFrameCount;
+
+        if (renderedFrameCount == 1)
+        {
+            // Time to first pixel, with uploads possibly still running
+            EndStartupPhase("firstFrame");
+        }
+    }
+
+    if (uploadPending_)
+    {
+        // The run ended before the uploads were taken over. Consume the
+        // semaphore so a later run can signal it again, and retire the
+        // staging regions with an empty frame.
+        vkWaitForFences(device_, 1, &uploadFence_, VK_TRUE, UINT64_MAX);
+        uploadPending_ = false;
+        uploadBatcher_->Clear();
+
+        const uint64_t frameValue = frameScheduler_->BeginFrame();
+        const VkSemaphore timelineSemaphore = frameScheduler_->GetTimelineSemaphore();
+        const VkPipelineStageFlags waitDstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+        timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineSubmitInfo.signalSemaphoreValueCount = 1;
+        timelineSubmitInfo.pSignalSemaphoreValues = &frameValue;
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineSubmitInfo;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &uploadCompleteSemaphore_;
+        submitInfo.pWaitDstStageMask = &waitDstStageMask;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &timelineSemaphore;
+        vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE);
+        stagingRing_->Release(frameValue);
+        stagingRing_->Submit(frameValue);
+    }
 
     // Wait for all rendering to finish
-    vkWaitForFences(device_, 3, frameFences_, VK_TRUE, UINT64_MAX);
+    frameScheduler_->WaitIdle();
+
+    for (auto& frame : frames_)
+    {
+        ReadTimestamps(frame);
+    }
+
+    const std::chrono::duration<double, std::milli> runTime =
+        std::chrono::high_resolution_clock::now() - runStart;
+
+    if (renderedFrameCount > 0)
+    {
+        const double frameTime = runTime.count() / renderedFrameCount;
+        DebugPrint("%d frames (%s) in %.2f ms, %.3f ms/frame, %.1f frames/s\n",
+            renderedFrameCount, headless_ ? "headless" : GetPresentModeName(presentMode_),
+            runTime.count(), frameTime, 1000.0 / frameTime);
+    }
+
+    if (!gpuFrameTimings_.empty())
+    {
+        double gpuFrameTime = 0;
+        for (const auto& timing : gpuFrameTimings_)
+        {
+            gpuFrameTime += timing.frameTime;
+        }
+
+        DebugPrint("GPU: %.3f ms/frame over %d frames\n",
+            gpuFrameTime / gpuFrameTimings_.size(),
+            static_cast<int> (gpuFrameTimings_.size()));
+    }
+
+    deviceMemoryAllocator_->GetStatistics(&memoryStatistics_);
+
+    const auto& memoryTotal = memoryStatistics_.total;
+    DebugPrint("Device memory: %d allocations, %.2f MiB used in %d blocks "
+        "(%.2f MiB, peak %.2f MiB), %.1f%% fragmented\n",
+        memoryTotal.allocationCount, memoryTotal.usedBytes / 1048576.0,
+        memoryTotal.blockCount, memoryTotal.blockBytes / 1048576.0,
+        memoryTotal.peakBlockBytes / 1048576.0,
+        memoryTotal.GetFragmentation() * 100.0);
+
+    defragmenter_->GetStatistics(&defragmentationStatistics_);
 
-    vkDestroySemaphore(device_, imageAcquiredSemaphore, nullptr);
-    vkDestroySemaphore(device_, renderingCompleteSemaphore, nullptr);
+    if (defragmentationStatistics_.moveCount > 0)
+    {
+        DebugPrint("Defragmentation: %d blocks emptied, %d moves (%.2f MiB), "
+            "%d passes aborted\n",
+            defragmentationStatistics_.evacuatedBlockCount,
+            defragmentationStatistics_.moveCount,
+            defragmentationStatistics_.movedBytes / 1048576.0,
+            defragmentationStatistics_.abortedPassCount);
+    }
+
+    if (hostAllocator_)
+    {
+        hostAllocator_->GetStatistics(&hostAllocationStatistics_);
+
+        DebugPrint("Host memory: %.2f KiB used (peak %.2f KiB), "
+            "%d pooled / %d system allocations, %d linear (%d overflowed)\n",
+            hostAllocationStatistics_.currentBytes / 1024.0,
+            hostAllocationStatistics_.peakBytes / 1024.0,
+            static_cast<int> (hostAllocationStatistics_.pooledAllocationCount),
+            static_cast<int> (hostAllocationStatistics_.systemAllocationCount),
+            static_cast<int> (hostAllocationStatistics_.linearAllocationCount),
+            static_cast<int> (hostAllocationStatistics_.linearOverflowCount));
+    }
 
     ShutdownImpl();
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::RecordCommandBuffer(VkCommandBuffer commandBuffer,
+    const uint32_t backBuffer, const VkCommandBufferUsageFlags usage,
+    const bool useWorkers, VkQueryPool timestampQueryPool)
+{
+    std::vector<VkCommandBuffer> secondaryCommandBuffers;
+
+    if (useWorkers)
+    {
+        secondaryCommandBuffers.resize(GetRenderTaskCount());
+
+        VkCommandBufferInheritanceInfo inheritanceInfo = {};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = renderPass_;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = framebuffer_[backBuffer];
+
+        workerPool_->Execute(static_cast<int> (secondaryCommandBuffers.size()),
+            [&](const int taskIndex, const int workerIndex) {
+            // Allocator 0 belongs to the thread calling Run()
+            VkCommandBuffer secondaryCommandBuffer = GetCommandAllocator(
+                currentFrameSlot_, workerIndex + 1).Allocate(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+            VkCommandBufferBeginInfo secondaryBeginInfo = {};
+            secondaryBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            secondaryBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+                | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            secondaryBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+            vkBeginCommandBuffer(secondaryCommandBuffer, &secondaryBeginInfo);
+            RenderTaskImpl(secondaryCommandBuffer, taskIndex);
+            vkEndCommandBuffer(secondaryCommandBuffer);
+
+            secondaryCommandBuffers[taskIndex] = secondaryCommandBuffer;
+        });
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = usage;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    if (timestampQueryPool != VK_NULL_HANDLE)
+    {
+        ResetAndBeginTimestamps(commandBuffer, timestampQueryPool);
+    }
+
+    VkRenderPassBeginInfo renderPassBeginInfo = {};
+    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBeginInfo.framebuffer = framebuffer_[backBuffer];
+    renderPassBeginInfo.renderArea.extent = renderExtent_;
+    renderPassBeginInfo.renderPass = renderPass_;
+
+    VkClearValue clearValues[2] = {};
+
+    clearValues[0].color.float32[0] = 0.042f;
+    clearValues[0].color.float32[1] = 0.042f;
+    clearValues[0].color.float32[2] = 0.042f;
+    clearValues[0].color.float32[3] = 1.0f;
+
+    clearValues[1].depthStencil.depth = 1.0f;
+
+    renderPassBeginInfo.pClearValues = clearValues;
+    renderPassBeginInfo.clearValueCount =
+        depthFormat_ != VK_FORMAT_UNDEFINED ? 2 : 1;
+
+    if (useWorkers)
+    {
+        // Only vkCmdExecuteCommands is allowed in a subpass with secondary
+        // contents, so the render timestamps bracket the whole render pass
+        if (timestampQueryPool != VK_NULL_HANDLE)
+        {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                timestampQueryPool, TQ_RenderBegin);
+        }
+
+        vkCmdBeginRenderPass(commandBuffer,
+            &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        vkCmdExecuteCommands(commandBuffer,
+            static_cast<uint32_t> (secondaryCommandBuffers.size()),
+            secondaryCommandBuffers.data());
+
+        vkCmdEndRenderPass(commandBuffer);
+
+        if (timestampQueryPool != VK_NULL_HANDLE)
+        {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                timestampQueryPool, TQ_RenderEnd);
+        }
+    }
+    else
+    {
+        vkCmdBeginRenderPass(commandBuffer,
+            &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        if (timestampQueryPool != VK_NULL_HANDLE)
+        {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                timestampQueryPool, TQ_RenderBegin);
+        }
+
+        RenderImpl(commandBuffer);
+
+        if (timestampQueryPool != VK_NULL_HANDLE)
+        {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                timestampQueryPool, TQ_RenderEnd);
+        }
+
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    if (timestampQueryPool != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            timestampQueryPool, TQ_FrameEnd);
+    }
+
+    vkEndCommandBuffer(commandBuffer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+CommandAllocator& VulkanSample::GetCommandAllocator(const int frameSlot,
+    const int threadIndex)
+{
+    return *commandAllocators_[frameSlot * threadCount_ + threadIndex];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+CommandAllocator& VulkanSample::GetFrameCommandAllocator()
+{
+    return GetCommandAllocator(currentFrameSlot_, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::AddFrameCommandBuffer(VkCommandBuffer commandBuffer)
+{
+    frameCommandBuffers_.push_back(commandBuffer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::GetSwapchainImages()
+{
+    uint32_t swapchainImageCount = 0;
+    vkGetSwapchainImagesKHR(device_, swapchain_,
+        &swapchainImageCount, nullptr);
+
+    swapchainImages_.resize(swapchainImageCount);
+    vkGetSwapchainImagesKHR(device_, swapchain_,
+        &swapchainImageCount, swapchainImages_.data());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool VulkanSample::CreateBackbufferResources()
+{
+    // The render pass does not keep depth across frames, so one depth
+    // buffer serves all back buffers. It goes first, so nothing else is
+    // left behind if there is no memory for it.
+    VkImageView depthView = VK_NULL_HANDLE;
+
+    if (depthFormat_ != VK_FORMAT_UNDEFINED)
+    {
+        transientAttachments_.reset(new TransientAttachmentPool{ device_,
+            *deviceMemoryAllocator_, *deviceMemoryProperties_, allocationCallbacks_ });
+
+        TransientAttachmentDesc depthDesc;
+        depthDesc.format = depthFormat_;
+        depthDesc.extent = renderExtent_;
+        depthDesc.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        depthDesc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+        depthAttachment_ = transientAttachments_->Add(depthDesc);
+
+        if (!transientAttachments_->Commit())
+        {
+            transientAttachments_.reset();
+            depthAttachment_ = -1;
+            return false;
+        }
+
+        depthView = transientAttachments_->GetView(depthAttachment_);
+    }
+
+    const int backbufferCount = static_cast<int> (swapchainImages_.size());
+    swapChainImageViews_.resize(backbufferCount);
+    framebuffer_.resize(backbufferCount);
+
+    CreateSwapchainImageViews(device_, swapchainFormat_,
+        backbufferCount, swapchainImages_.data(), swapChainImageViews_.data(),
+        allocationCallbacks_);
+
+    if (!headless_)
+    {
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        renderingCompleteSemaphores_.resize(backbufferCount);
+
+        for (auto& semaphore : renderingCompleteSemaphores_)
+        {
+            vkCreateSemaphore(device_, &semaphoreCreateInfo,
+                allocationCallbacks_, &semaphore);
+        }
+    }
+
+    CreateFramebuffers(device_, renderPass_, renderExtent_.width, renderExtent_.height,
+        backbufferCount, swapChainImageViews_.data(), depthView, framebuffer_.data(),
+        allocationCallbacks_);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool VulkanSample::RecreateSwapchain()
+{
+    const int windowWidth = window_->GetWidth();
+    const int windowHeight = window_->GetHeight();
+
+    VkExtent2D extent;
+    VkSwapchainKHR swapchain = CreateSwapchain(physicalDevice_, device_, surface_,
+        windowWidth, windowHeight, presentMode_,
+        swapchain_, importTable_.get(), nullptr, &extent, allocationCallbacks_);
+
+    if (swapchain == VK_NULL_HANDLE)
+    {
+        return false;
+    }
+
+    // Frames which are still in flight reference the old swapchain, its
+    // views, framebuffers and depth buffer, and maybe the pre-recorded command buffers.
+    // Instead of waiting for the device to go idle, keep them alive until
+    // the last frame submitted so far has retired.
+    const VkDevice device = device_;
+    const VkAllocationCallbacks* allocationCallbacks = allocationCallbacks_;
+    const VkCommandPool commandPool = commandPool_;
+    const VkSwapchainKHR oldSwapchain = swapchain_;
+    const std::vector<VkImageView> imageViews = swapChainImageViews_;
+    const std::vector<VkFramebuffer> framebuffers = framebuffer_;
+    const std::vector<VkSemaphore> renderingCompleteSemaphores = renderingCompleteSemaphores_;
+    const std::shared_ptr<TransientAttachmentPool> transientAttachments(
+        std::move(transientAttachments_));
+
+    std::vector<VkCommandBuffer> commandBuffers;
+    for (const auto& staticCommandBuffer : staticCommandBuffers_)
+    {
+        if (staticCommandBuffer.commandBuffer != VK_NULL_HANDLE)
+        {
+            commandBuffers.push_back(staticCommandBuffer.commandBuffer);
+        }
+    }
+
+    deletionQueue_->Enqueue([=]() {
+        for (std::size_t i = 0; i < framebuffers.size(); ++i)
+        {
+            vkDestroyFramebuffer(device, framebuffers[i], allocationCallbacks);
+            vkDestroyImageView(device, imageViews[i], allocationCallbacks);
+        }
+
+        for (auto semaphore : renderingCompleteSemaphores)
+        {
+            vkDestroySemaphore(device, semaphore, allocationCallbacks);
+        }
+
+        if (!commandBuffers.empty())
+        {
+            vkFreeCommandBuffers(device, commandPool,
+                static_cast<uint32_t> (commandBuffers.size()),
+                commandBuffers.data());
+        }
+
+        if (transientAttachments)
+        {
+            transientAttachments->Clear();
+        }
+
+        vkDestroySwapchainKHR(device, oldSwapchain, allocationCallbacks);
+    });
+
+    // Gone with the old swapchain, whatever happens below
+    swapChainImageViews_.clear();
+    framebuffer_.clear();
+    renderingCompleteSemaphores_.clear();
+
+    swapchain_ = swapchain;
+    renderExtent_ = extent;
+    swapchainWindowWidth_ = windowWidth;
+    swapchainWindowHeight_ = windowHeight;
+
+    GetSwapchainImages();
+
+    if (recordOnce_)
+    {
+        staticCommandBuffers_.assign(swapchainImages_.size(), StaticCommandBuffer());
+    }
+
+    // The pipelines are built for the render pass, so it has to keep its
+    // depth attachment. Stay out of date and try again next frame.
+    if (!CreateBackbufferResources())
+    {
+        DebugPrint("Could not allocate the depth buffer for %ux%u\n",
+            extent.width, extent.height);
+        return false;
+    }
+
+    swapchainOutOfDate_ = false;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::SignalFrame(const uint64_t frameValue)
+{
+    const VkSemaphore timelineSemaphore = frameScheduler_->GetTimelineSemaphore();
+
+    VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+    timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineSubmitInfo.signalSemaphoreValueCount = 1;
+    timelineSubmitInfo.pSignalSemaphoreValues = &frameValue;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineSubmitInfo;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &timelineSemaphore;
+    vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE);
+    stagingRing_->Submit(frameValue);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::EndStartupPhase(const char* name)
+{
+    const auto now = std::chrono::high_resolution_clock::now();
+
+    StartupTiming timing;
+    timing.name = name;
+    timing.time = std::chrono::duration<double, std::milli>(now - phaseStart_).count();
+    startupTimings_.push_back(timing);
+
+    phaseStart_ = now;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::ReadTimestamps(FrameResources& frame)
+{
+    if (frame.timestampFrame == 0)
+    {
+        return;
+    }
+
+    // No WAIT_BIT - the frame has retired, so if the results are not
+    // available now, they never will be
+    uint64_t timestamps[TQ_Count] = {};
+    const VkResult result = vkGetQueryPoolResults(device_, frame.timestampQueryPool,
+        0, TQ_Count, sizeof(timestamps), timestamps, sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+
+    if (result == VK_SUCCESS)
+    {
+        // timestampPeriod is in nanoseconds per tick
+        const double ticksToMilliseconds = timestampPeriod_ / 1000000.0;
+
+        GpuFrameTiming timing;
+        timing.frame = frame.timestampFrame;
+        timing.frameTime = (timestamps[TQ_FrameEnd] - timestamps[TQ_FrameBegin]) * ticksToMilliseconds;
+        timing.renderTime = (timestamps[TQ_RenderEnd] - timestamps[TQ_RenderBegin]) * ticksToMilliseconds;
+
+        gpuFrameTimings_.push_back(timing);
+    }
+
+    frame.timestampFrame = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::AddUploadBarrier(const VkBufferMemoryBarrier& barrier,
+    const VkPipelineStageFlags dstStageMask)
+{
+    uploadBatcher_->AddBarrier(barrier, dstStageMask);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::AddUploadBarrier(const VkImageMemoryBarrier& barrier,
+    const VkPipelineStageFlags dstStageMask)
+{
+    uploadBatcher_->AddBarrier(barrier, dstStageMask);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::RecordUploadBarriers(VkCommandBuffer commandBuffer,
+    const bool acquire)
+{
+    // Without a transfer queue, this is a plain barrier after the copies.
+    // Otherwise the release half goes to the end of the upload, and the
+    // acquire half - with the same layouts - to the graphics queue.
+    if (transferQueue_ == VK_NULL_HANDLE)
+    {
+        uploadBatcher_->RecordBarriers(commandBuffer, UBM_Local,
+            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+    }
+    else
+    {
+        uploadBatcher_->RecordBarriers(commandBuffer,
+            acquire ? UBM_Acquire : UBM_Release,
+            transferQueueFamilyIndex_, queueFamilyIndex_);
+    }
+
+    // Done once both halves are recorded
+    if (acquire || transferQueue_ == VK_NULL_HANDLE)
+    {
+        uploadBatcher_->Clear();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+MemoryUsage VulkanSample::GetUploadMemoryUsage(
+    const VkMemoryRequirements& memoryRequirements) const
+{
+    if (memoryRequirements.size <= directUploadLimit_ &&
+        deviceMemoryProperties_->FindMemoryType(memoryRequirements.memoryTypeBits,
+            MU_CpuToGpuDeviceLocal, memoryRequirements.size) != -1)
+    {
+        return MU_CpuToGpuDeviceLocal;
+    }
+
+    return MU_GpuOnly;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::InvalidateCommandBuffers()
+{
+    for (auto& staticCommandBuffer : staticCommandBuffers_)
+    {
+        staticCommandBuffer.valid = false;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool VulkanSample::InitializeImpl(VkCommandBuffer /*commandBuffer*/)
+{
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::ShutdownImpl()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::UploadsCompleteImpl()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanSample::RenderImpl(VkCommandBuffer commandBuffer)
+{
+    // Without worker threads, render tasks are recorded in order into the
+    // primary command buffer
+    for (int i = 0; i < GetRenderTaskCount(); ++i)
+    {
+        RenderTaskImpl(commandBuffer, i);
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-void VulkanSample::InitializeImpl(VkCommandBuffer /*commandBuffer*/)
+int VulkanSample::GetRenderTaskCount() const
 {
+    return 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-void VulkanSample::RenderImpl(VkCommandBuffer /*commandBuffer*/)
+void VulkanSample::RenderTaskImpl(VkCommandBuffer /*commandBuffer*/,
+    const int /*taskIndex*/)
 {
 }
 
@@ -23,13 +23,166 @@
 #ifndef AMD_VULKAN_SAMPLE_H_
 #define AMD_VULKAN_SAMPLE_H_
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #include <vulkan/vulkan.h>
+#include <chrono>
 #include <memory>
+#include <vector>
+
+#include "DeviceMemoryAllocator.h"
+#include "DeviceMemoryDefragmenter.h"
+#include "HostAllocator.h"
 
 namespace AMD
 {
-class Window;
+class IWindow;
+class CommandAllocator;
+class DeferredDeletionQueue;
+class FrameScheduler;
+class StagingRing;
+class TransientAttachmentPool;
+class UploadBatcher;
+class WorkerPool;
+
+///////////////////////////////////////////////////////////////////////////////
+struct SampleOptions
+{
+    int width = 1280;
+    int height = 720;
+
+    /**
+    * Render into device-owned images instead of a window swapchain. No
+    * surface or swapchain extensions are enabled in this mode, so it works
+    * on machines without a display (for instance with a software ICD.)
+    * On platforms without window support, this is always enabled.
+    */
+    bool headless = false;
+
+    /**
+    * Number of frames the CPU may record ahead of the GPU. Each frame in
+    * flight has its own semaphores and command buffer. This is
+    * independent of the number of swapchain images.
+    */
+    int framesInFlight = 3;
+
+    /**
+    * Preferred present mode. If the surface does not support it, the
+    * closest supported mode is used instead: IMMEDIATE falls back to
+    * MAILBOX, MAILBOX to IMMEDIATE, and everything ends up at FIFO, which
+    * is always available.
+    */
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+    /**
+    * Benchmark mode: ignore presentMode and pick a mode which does not wait
+    * for vertical blank (IMMEDIATE, then MAILBOX), so Run() measures the
+    * render throughput instead of the display refresh rate.
+    */
+    bool uncapped = false;
+
+    /**
+    * Record the frame commands once per back buffer and resubmit them
+    * every frame instead of calling RenderImpl() each frame. Samples which
+    * change what they draw must call InvalidateCommandBuffers().
+    */
+    bool recordOnce = false;
+
+    /**
+    * Number of threads used to record render tasks into secondary command
+    * buffers, see VulkanSample::GetRenderTaskCount(). With 0, everything is
+    * recorded on the thread calling Run().
+    */
+    int workerThreadCount = 0;
+
+    /**
+    * Size of the staging ring all uploads go through. Larger uploads
+    * than this are not possible, and uploads which don't fit into the
+    * free part of the ring wait for earlier frames to retire.
+    */
+    VkDeviceSize stagingBufferSize = 32 << 20;
+
+    /**
+    * Give the render pass a depth attachment. It is a transient
+    * attachment, cleared on load and discarded on store, so on tilers it
+    * usually never touches memory. Off by default - the samples don't
+    * depth test, and elsewhere it costs a full size clear every frame.
+    * Dropped if there is no memory for it, see HasDepthBuffer().
+    */
+    bool depthBuffer = false;
+
+    /**
+    * Route all driver-side host allocations through a pooled
+    * HostAllocator instead of the driver's own allocator. Without it, no
+    * host memory statistics are available.
+    */
+    bool hostAllocator = true;
+
+    /**
+    * Device memory the defragmenter may copy per frame while it empties
+    * a sparse block, see DeviceMemoryDefragmenter. 0 disables it, the
+    * defragmenter still accepts registrations in that case.
+    */
+    VkDeviceSize defragmentationBudget = 16 << 20;
+
+    /**
+    * Run the uploads of InitializeImpl() on a transfer-only queue family,
+    * if the device has one, so they don't compete with rendering. The
+    * resources are handed to the graphics queue with ownership transfers,
+    * see VulkanSample::AddUploadBarrier().
+    */
+    bool transferQueue = true;
+
+    /**
+    * Uploads up to this size go straight into DEVICE_LOCAL | HOST_VISIBLE
+    * memory instead of through the staging ring, if the device exposes
+    * all of its memory that way (resizable BAR). Larger uploads, and all
+    * of them without resizable BAR, are staged. 0 disables direct writes.
+    */
+    VkDeviceSize directUploadLimit = 1 << 20;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* GPU time spent on one frame, measured with timestamp queries. Times are
+* in milliseconds.
+*/
+struct GpuFrameTiming
+{
+    // Frame value as handed out by the frame scheduler
+    uint64_t frame = 0;
+    // From the start of the frame's command buffer to the end of the
+    // render pass
+    double frameTime = 0;
+    // Around RenderImpl(), respectively the pre-recorded or secondary
+    // command buffers
+    double renderTime = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* CPU time spent on one frame, in milliseconds.
+*/
+struct CpuFrameTiming
+{
+    uint64_t frame = 0;
+    // Whole iteration of the frame loop in Run(), including waiting for
+    // the frame slot, acquire and present
+    double frameTime = 0;
+    // Recording the frame's command buffers only
+    double recordTime = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Time spent in one phase of the start-up, in milliseconds.
+*/
+struct StartupTiming
+{
+    const char* name = nullptr;
+    double time = 0;
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 class VulkanSample
@@ -38,24 +191,292 @@ public:
     VulkanSample(const VulkanSample&) = delete;
     VulkanSample& operator= (const VulkanSample&) = delete;
 
-    VulkanSample();
+    explicit VulkanSample(const SampleOptions& options = SampleOptions());
     virtual ~VulkanSample();
 
     bool IsInitialized() { return (instance_ != VK_NULL_HANDLE && device_ != VK_NULL_HANDLE); }
-    void Run(const int frameCount);
+    /**
+    * Returns false if the sample is not initialized, or if InitializeImpl()
+    * failed - nothing is rendered in either case.
+    */
+    bool Run(const int frameCount);
+
+    /**
+    * GPU timings of all frames rendered by Run() so far, oldest first. The
+    * results are read back once a frame has retired, without stalling, so
+    * frames whose timestamps were not available are missing. Empty if the
+    * queue does not support timestamps.
+    */
+    const std::vector<GpuFrameTiming>& GetGpuFrameTimings() const
+    {
+        return gpuFrameTimings_;
+    }
+
+    /**
+    * CPU timings of all frames rendered by Run() so far, oldest first.
+    */
+    const std::vector<CpuFrameTiming>& GetCpuFrameTimings() const
+    {
+        return cpuFrameTimings_;
+    }
+
+    /**
+    * Start-up phases in the order they happened: instance, device and
+    * swapchain creation and per-frame resources in the constructor, and
+    * the sample's InitializeImpl() including the upload in Run().
+    */
+    const std::vector<StartupTiming>& GetStartupTimings() const
+    {
+        return startupTimings_;
+    }
+
+    /**
+    * Device memory use as of the end of Run(), after the last frame and
+    * before ShutdownImpl(). Peaks cover the whole run including start-up.
+    */
+    const DeviceMemoryStatistics& GetMemoryStatistics() const
+    {
+        return memoryStatistics_;
+    }
+
+    /**
+    * Host memory the driver allocated through the HostAllocator, as of
+    * the end of Run(). All zero if the sample runs without one.
+    */
+    const HostAllocationStatistics& GetHostAllocationStatistics() const
+    {
+        return hostAllocationStatistics_;
+    }
+
+    /**
+    * Moves done by the defragmenter, as of the end of Run().
+    */
+    const DefragmentationStatistics& GetDefragmentationStatistics() const
+    {
+        return defragmentationStatistics_;
+    }
+
+    /**
+    * SampleOptions::directUploadLimit, or 0 if the device has no resizable
+    * BAR and all uploads are staged.
+    */
+    VkDeviceSize GetDirectUploadLimit() const
+    {
+        return directUploadLimit_;
+    }
+
+    /**
+    * The present mode in use, which can differ from
+    * SampleOptions::presentMode - see SampleOptions::uncapped and the
+    * fallbacks. Meaningless in headless mode.
+    */
+    VkPresentModeKHR GetPresentMode() const
+    {
+        return presentMode_;
+    }
+
+    /**
+    * Whether the render pass has a depth attachment, which can differ from
+    * SampleOptions::depthBuffer.
+    */
+    bool HasDepthBuffer() const
+    {
+        return depthFormat_ != VK_FORMAT_UNDEFINED;
+    }
+
     struct ImportTable;
 
 protected:
+    /**
+    * Index of the frame in flight which is currently being recorded, in
+    * the range [0, GetQueueSlotCount()). Use this to index per-frame
+    * resources.
+    */
     int GetQueueSlot() const
     {
-        return currentBackBuffer_;
+        return currentFrameSlot_;
     }
 
-    static const int QUEUE_SLOT_COUNT = 3;
+    int GetQueueSlotCount() const
+    {
+        return static_cast<int> (frames_.size());
+    }
+
+    /**
+    * Timeline of all frames submitted by Run(). Use this to find out
+    * whether the GPU is done with resources used by a given frame.
+    */
+    FrameScheduler& GetFrameScheduler() const
+    {
+        return *frameScheduler_;
+    }
 
-    static int GetQueueSlotCount()
+    /**
+    * Shared allocator for buffer and image memory. Derived classes must
+    * free their allocations before the base destructor runs, which
+    * UniqueAllocation takes care of.
+    */
+    DeviceMemoryAllocator& GetDeviceMemoryAllocator() const
     {
-        return QUEUE_SLOT_COUNT;
+        return *deviceMemoryAllocator_;
+    }
+
+    /**
+    * Upload memory for InitializeImpl() and RenderImpl(). Regions
+    * allocated while recording are reclaimed once the frame retires.
+    */
+    StagingRing& GetStagingRing() const
+    {
+        return *stagingRing_;
+    }
+
+    /**
+    * Batches the uploads of InitializeImpl(). Its copies are recorded into
+    * the upload command buffer after InitializeImpl() returns, followed by
+    * the barriers - handed over to the graphics queue like those from
+    * AddUploadBarrier(). Only valid from InitializeImpl().
+    */
+    UploadBatcher& GetUploadBatcher() const
+    {
+        return *uploadBatcher_;
+    }
+
+    /**
+    * Where to place a buffer which is uploaded once. MU_CpuToGpuDeviceLocal
+    * if it can be written directly - see SampleOptions::directUploadLimit -
+    * MU_GpuOnly otherwise. UploadBatcher::AddBufferUpload() writes mapped
+    * allocations directly and stages the others.
+    */
+    MemoryUsage GetUploadMemoryUsage(const VkMemoryRequirements& memoryRequirements) const;
+
+    /**
+    * Objects handed to this queue - usually by resetting a UniqueHandle -
+    * are destroyed once the frame being recorded has retired. Entries
+    * left at shutdown are destroyed by the base destructor.
+    */
+    DeferredDeletionQueue& GetDeletionQueue() const
+    {
+        return *deletionQueue_;
+    }
+
+    /**
+    * Register resources here to let them move out of sparse blocks. The
+    * moves are recorded at the start of a frame, before RenderImpl(), and
+    * pre-recorded command buffers are invalidated when something moved.
+    */
+    DeviceMemoryDefragmenter& GetDefragmenter() const
+    {
+        return *defragmenter_;
+    }
+
+    /**
+    * Callbacks for every vkCreate* and vkDestroy* call made by the
+    * sample. May be null, which is fine to pass on to Vulkan.
+    */
+    const VkAllocationCallbacks* GetAllocationCallbacks() const
+    {
+        return allocationCallbacks_;
+    }
+
+    /**
+    * Memory types and heaps of physicalDevice_, queried once at device
+    * creation.
+    */
+    const DeviceMemoryProperties& GetDeviceMemoryProperties() const
+    {
+        return *deviceMemoryProperties_;
+    }
+
+    /**
+    * In record-once mode, force all pre-recorded command buffers to be
+    * recorded again - by calling RenderImpl() - the next time they are
+    * used. Does nothing otherwise.
+    */
+    void InvalidateCommandBuffers();
+
+    /**
+    * Hand a resource written by the upload command buffer of
+    * InitializeImpl() over to rendering. barrier describes the transition
+    * from the copy - TRANSFER_WRITE, and TRANSFER_DST_OPTIMAL for images -
+    * to the first use in dstStageMask. The queue family indices are
+    * filled in.
+    *
+    * With a transfer queue, this becomes a release barrier at the end of
+    * the upload and an acquire barrier on the graphics queue, recorded
+    * into the first frame that starts after the upload has finished.
+    * Until then, AreUploadsComplete() returns false and rendering must use
+    * placeholders. Otherwise it is a barrier at the end of the upload.
+    * Either way, the upload command buffer must only use transfer stages,
+    * and uploaded resources must use exclusive sharing.
+    */
+    void AddUploadBarrier(const VkBufferMemoryBarrier& barrier,
+        const VkPipelineStageFlags dstStageMask);
+    void AddUploadBarrier(const VkImageMemoryBarrier& barrier,
+        const VkPipelineStageFlags dstStageMask);
+
+    /**
+    * Queue family the command buffer passed to InitializeImpl() belongs
+    * to. The graphics family if there is no transfer queue.
+    */
+    int GetUploadQueueFamilyIndex() const
+    {
+        return transferQueue_ != VK_NULL_HANDLE
+            ? transferQueueFamilyIndex_ : queueFamilyIndex_;
+    }
+
+    /**
+    * Whether the resources uploaded by InitializeImpl() may be used by the
+    * frame being recorded. Run() does not wait for the uploads, so this
+    * stays false for the first frames if they run on a transfer queue.
+    */
+    bool AreUploadsComplete() const
+    {
+        return !uploadPending_;
+    }
+
+    /**
+    * Graphics queue command buffer which executes before the first frame,
+    * without waiting for the uploads. Only valid from InitializeImpl(),
+    * use it for placeholders and small data needed right away.
+    */
+    VkCommandBuffer GetSetupCommandBuffer() const
+    {
+        return setupCommandBuffer_;
+    }
+
+    /**
+    * Command allocator of the current frame slot for the thread calling
+    * Run(). Hand out as many command buffers as needed, they are recycled
+    * once the GPU is done with this frame.
+    */
+    CommandAllocator& GetFrameCommandAllocator();
+
+    /**
+    * Submit a primary command buffer - usually one from
+    * GetFrameCommandAllocator() - with the current frame. It executes
+    * before the frame's render pass, in the order buffers were added.
+    * Only valid while the frame is recorded, that is, from RenderImpl() on
+    * the thread calling Run().
+    */
+    void AddFrameCommandBuffer(VkCommandBuffer commandBuffer);
+
+    /**
+    * Size of the back buffers. Use this instead of the window size for
+    * viewports, the window can already have a different size while the
+    * swapchain has not been recreated yet.
+    */
+    VkExtent2D GetRenderExtent() const
+    {
+        return renderExtent_;
+    }
+
+    /**
+    * Format of the render pass depth attachment, VK_FORMAT_UNDEFINED if
+    * there is none.
+    */
+    VkFormat GetDepthFormat() const
+    {
+        return depthFormat_;
     }
 
     VkViewport viewport_;
@@ -70,27 +491,159 @@ protected:
 
     std::unique_ptr<ImportTable> importTable_;
 
-    VkFence frameFences_[QUEUE_SLOT_COUNT];
-    VkImage swapchainImages_[QUEUE_SLOT_COUNT];
-    VkImageView swapChainImageViews_[QUEUE_SLOT_COUNT];
-    VkFramebuffer framebuffer_[QUEUE_SLOT_COUNT];
+    // In headless mode, these are owned by the sample and bound to
+    // headlessImageMemory_, otherwise they belong to the swapchain
+    std::vector<VkImage> swapchainImages_;
+    std::vector<VkImageView> swapChainImageViews_;
+    std::vector<VkFramebuffer> framebuffer_;
 
     VkRenderPass renderPass_ = VK_NULL_HANDLE;
 
     int queueFamilyIndex_ = -1;
 
-    std::unique_ptr<Window> window_;
+    bool headless_ = false;
+
+    std::unique_ptr<IWindow> window_;
 
-    virtual void InitializeImpl(VkCommandBuffer commandBuffer);
+    /**
+    * Create resources and record their uploads. commandBuffer belongs to
+    * GetUploadQueueFamilyIndex(), see AddUploadBarrier(). Return false if
+    * a resource could not be created, Run() gives up then.
+    */
+    virtual bool InitializeImpl(VkCommandBuffer commandBuffer);
     virtual void RenderImpl(VkCommandBuffer commandBuffer);
+
+    /**
+    * To allow recording on worker threads, split the frame into tasks
+    * instead of overriding RenderImpl(). Each task is recorded into its own
+    * secondary command buffer, possibly concurrently with other tasks, and
+    * the buffers are executed in task order. Without workers, the default
+    * RenderImpl() records all tasks in order.
+    *
+    * A secondary command buffer does not inherit any state except for the
+    * render pass, so every task must bind its own pipeline and state.
+    */
+    virtual int GetRenderTaskCount() const;
+    virtual void RenderTaskImpl(VkCommandBuffer commandBuffer, const int taskIndex);
+
+    /**
+    * Called at the end of Run(), once the device is idle. Resources held
+    * in UniqueHandles don't need to be released here, the device outlives
+    * the derived class.
+    */
     virtual void ShutdownImpl();
 
+    /**
+    * Called from Run() before RenderImpl() in the frame in which
+    * AreUploadsComplete() turns true. Replace the placeholders here,
+    * pre-recorded command buffers are invalidated afterwards.
+    */
+    virtual void UploadsCompleteImpl();
+
 private:
+    void RecordCommandBuffer(VkCommandBuffer commandBuffer,
+        const uint32_t backBuffer, const VkCommandBufferUsageFlags usage,
+        const bool useWorkers, VkQueryPool timestampQueryPool);
+
+    CommandAllocator& GetCommandAllocator(const int frameSlot, const int threadIndex);
+
+    struct FrameResources
+    {
+        VkSemaphore imageAcquiredSemaphore = VK_NULL_HANDLE;
+
+        VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+        // Frame whose timestamps are pending in the query pool, 0 if none
+        uint64_t timestampFrame = 0;
+    };
+
+    void ReadTimestamps(FrameResources& frame);
+
+    void GetSwapchainImages();
+    bool CreateBackbufferResources();
+    bool RecreateSwapchain();
+    void SignalFrame(const uint64_t frameValue);
+    void RecordUploadBarriers(VkCommandBuffer commandBuffer, const bool acquire);
+    void EndStartupPhase(const char* name);
+
+    std::vector<FrameResources> frames_;
+
+    float timestampPeriod_ = 1.0f;
+    std::vector<GpuFrameTiming> gpuFrameTimings_;
+    std::vector<CpuFrameTiming> cpuFrameTimings_;
+
+    std::chrono::high_resolution_clock::time_point phaseStart_;
+    std::vector<StartupTiming> startupTimings_;
+    DeviceMemoryStatistics memoryStatistics_;
+    HostAllocationStatistics hostAllocationStatistics_;
+    DefragmentationStatistics defragmentationStatistics_;
+    std::unique_ptr<HostAllocator> hostAllocator_;
+    const VkAllocationCallbacks* allocationCallbacks_ = nullptr;
+    std::unique_ptr<FrameScheduler> frameScheduler_;
+    std::unique_ptr<DeviceMemoryProperties> deviceMemoryProperties_;
+    std::unique_ptr<DeviceMemoryAllocator> deviceMemoryAllocator_;
+    std::unique_ptr<StagingRing> stagingRing_;
+    std::unique_ptr<DeferredDeletionQueue> deletionQueue_;
+    std::unique_ptr<DeviceMemoryDefragmenter> defragmenter_;
+    bool defragment_ = false;
+    VkDeviceSize directUploadLimit_ = 0;
+
+    struct StaticCommandBuffer
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        // Last frame which submitted this command buffer
+        uint64_t lastFrame = 0;
+        bool valid = false;
+    };
+
+    bool recordOnce_ = false;
+    std::vector<StaticCommandBuffer> staticCommandBuffers_;
+
+    std::unique_ptr<WorkerPool> workerPool_;
+
+    // One per thread (the one calling Run() and the workers) and frame
+    // slot, indexed by frame slot * thread count + thread index
+    int threadCount_ = 1;
+    std::vector<std::unique_ptr<CommandAllocator>> commandAllocators_;
+    std::vector<VkCommandBuffer> frameCommandBuffers_;
+
     VkCommandPool commandPool_;
-    VkCommandBuffer commandBuffers_[QUEUE_SLOT_COUNT];
     VkCommandBuffer setupCommandBuffer_;
+
+    // Only set if there is a transfer-only queue family and
+    // SampleOptions::transferQueue is enabled
+    VkQueue transferQueue_ = VK_NULL_HANDLE;
+    int transferQueueFamilyIndex_ = -1;
+    VkCommandPool transferCommandPool_ = VK_NULL_HANDLE;
+    VkCommandBuffer uploadCommandBuffer_ = VK_NULL_HANDLE;
+    VkSemaphore uploadCompleteSemaphore_ = VK_NULL_HANDLE;
+    VkFence uploadFence_ = VK_NULL_HANDLE;
+    bool uploadPending_ = false;
+
+    std::unique_ptr<UploadBatcher> uploadBatcher_;
+    int currentFrameSlot_ = 0;
     uint32_t currentBackBuffer_ = 0;
 
+    VkPresentModeKHR presentMode_ = VK_PRESENT_MODE_FIFO_KHR;
+    VkFormat swapchainFormat_ = VK_FORMAT_UNDEFINED;
+    // One per swapchain image, waited on by its present. A retired frame
+    // doesn't mean the present engine is done waiting, but the image
+    // being acquired again does.
+    std::vector<VkSemaphore> renderingCompleteSemaphores_;
+    VkFormat depthFormat_ = VK_FORMAT_UNDEFINED;
+    VkExtent2D renderExtent_ = {};
+    // Window size the swapchain was last created for. The swapchain extent
+    // is clamped to the surface limits and can differ from it permanently.
+    int swapchainWindowWidth_ = 0;
+    int swapchainWindowHeight_ = 0;
+    bool swapchainOutOfDate_ = false;
+
+    // Depth (and any other attachment which lives only inside the render
+    // pass), sized like the back buffers
+    std::unique_ptr<TransientAttachmentPool> transientAttachments_;
+    int depthAttachment_ = -1;
+
+    std::vector<DeviceMemoryAllocation> headlessImageMemory_;
+
 #ifdef _DEBUG
     VkDebugReportCallbackEXT debugCallback_;
 #endif
@@ -23,45 +23,23 @@
 #include "VulkanTexturedQuad.h"
 
 #include "Shaders.h"
+#include "UploadBatcher.h"
 #include "Utility.h"
 #include "Window.h"
 
 #include "RubyTexture.h"
 #include "ImageIO.h"
 
+#include <algorithm>
+#include <cassert>
 #include <vector>
 
 namespace AMD
 {
 ///////////////////////////////////////////////////////////////////////////////
-void VulkanTexturedQuad::ShutdownImpl()
+VulkanTexturedQuad::VulkanTexturedQuad(const SampleOptions& options)
+    : VulkanSample(options)
 {
-    vkDestroyPipeline(device_, pipeline_, nullptr);
-    vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
-
-    vkDestroyBuffer(device_, vertexBuffer_, nullptr);
-    vkDestroyBuffer(device_, indexBuffer_, nullptr);
-    vkFreeMemory(device_, deviceBufferMemory_, nullptr);
-
-    vkDestroyImageView (device_, rubyImageView_, nullptr);
-    vkDestroyImage (device_, rubyImage_, nullptr);
-    vkFreeMemory (device_, deviceImageMemory_, nullptr);
-
-    vkDestroyBuffer (device_, uploadImageBuffer_, nullptr);
-    vkFreeMemory (device_, uploadImageMemory_, nullptr);
-
-    vkDestroyBuffer (device_, uploadBufferBuffer_, nullptr);
-    vkFreeMemory (device_, uploadBufferMemory_, nullptr);
-
-    vkDestroyDescriptorSetLayout (device_, descriptorSetLayout_, nullptr);
-    vkDestroyDescriptorPool (device_, descriptorPool_, nullptr);
-
-    vkDestroySampler (device_, sampler_, nullptr);
-
-    vkDestroyShaderModule(device_, vertexShader_, nullptr);
-    vkDestroyShaderModule(device_, fragmentShader_, nullptr);
-
-    VulkanSample::ShutdownImpl();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -69,150 +47,84 @@ void VulkanTexturedQuad::RenderImpl(VkCommandBuffer commandBuffer)
 {
     VulkanSample::RenderImpl(commandBuffer);
 
+    // Nothing to sample, see UpdateDescriptorSet()
+    if (descriptorSet_ == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    const VkExtent2D renderExtent = GetRenderExtent ();
+
     VkViewport viewports [1] = {};
-    viewports [0].width = static_cast<float> (window_->GetWidth ());
-    viewports [0].height = static_cast<float> (window_->GetHeight ());
+    viewports [0].width = static_cast<float> (renderExtent.width);
+    viewports [0].height = static_cast<float> (renderExtent.height);
     viewports [0].minDepth = 0;
     viewports [0].maxDepth = 1;
 
     vkCmdSetViewport (commandBuffer, 0, 1, viewports);
 
     VkRect2D scissors [1] = {};
-    scissors [0].extent.width = window_->GetWidth ();
-    scissors [0].extent.height = window_->GetHeight ();
+    scissors [0].extent = renderExtent;
     vkCmdSetScissor (commandBuffer, 0, 1, scissors);
 
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-        pipeline_);
+        pipeline_.Get());
     VkDeviceSize offsets[] = { 0 };
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer_, 0, VK_INDEX_TYPE_UINT32);
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer_, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer_.Get(), 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffer_.GetAddress(), offsets);
 
     vkCmdBindDescriptorSets (commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-        pipelineLayout_, 0, 1, &descriptorSet_, 0, nullptr);
+        pipelineLayout_.Get (), 0, 1, &descriptorSet_, 0, nullptr);
 
     vkCmdDrawIndexed(commandBuffer, 6, 1, 0, 0, 0);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-void VulkanTexturedQuad::InitializeImpl(VkCommandBuffer uploadCommandBuffer)
+bool VulkanTexturedQuad::InitializeImpl(VkCommandBuffer uploadCommandBuffer)
 {
     VulkanSample::InitializeImpl(uploadCommandBuffer);
 
+    // The texture arrives later, possibly after the first frames. The mesh
+    // is tiny and needed right away, so it goes through the setup command
+    // buffer and the quad shows the placeholder meanwhile.
     CreateSampler ();
-    CreateTexture (uploadCommandBuffer);
-    CreateDescriptors ();
-    CreatePipelineStateObject();
-    CreateMeshBuffers(uploadCommandBuffer);
-}
+    CreateTexture ();
 
-namespace
-{
-struct MemoryTypeInfo
-{
-    bool deviceLocal = false;
-    bool hostVisible = false;
-    bool hostCoherent = false;
-    bool hostCached = false;
-    bool lazilyAllocated = false;
-
-    struct Heap
-    {
-        uint64_t size = 0;
-        bool deviceLocal = false;
-    };
-
-    Heap heap;
-    int index;
-};
-
-///////////////////////////////////////////////////////////////////////////////
-std::vector<MemoryTypeInfo> EnumerateHeaps(VkPhysicalDevice device)
-{
-    VkPhysicalDeviceMemoryProperties memoryProperties = {};
-    vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
-
-    std::vector<MemoryTypeInfo::Heap> heaps;
-
-    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
-    {
-        MemoryTypeInfo::Heap info;
-        info.size = memoryProperties.memoryHeaps[i].size;
-        info.deviceLocal = (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
-
-        heaps.push_back(info);
-    }
-
-    std::vector<MemoryTypeInfo> result;
-
-    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+    // Also stands in for good if the texture could not be staged
+    if (!AreUploadsComplete () || rubyImageView_.Get () == VK_NULL_HANDLE)
     {
-        MemoryTypeInfo typeInfo;
-
-        typeInfo.deviceLocal = (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
-        typeInfo.hostVisible = (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
-        typeInfo.hostCoherent = (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
-        typeInfo.hostCached = (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
-        typeInfo.lazilyAllocated = (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
-
-        typeInfo.heap = heaps[memoryProperties.memoryTypes[i].heapIndex];
-
-        typeInfo.index = static_cast<int> (i);
-
-        result.push_back(typeInfo);
+        if (!CreatePlaceholderTexture (GetSetupCommandBuffer ()))
+        {
+            return false;
+        }
     }
 
-    return result;
+    CreateDescriptors ();
+    CreatePipelineStateObject();
+    return CreateMeshBuffers(GetSetupCommandBuffer());
 }
 
-enum MemoryProperties
-{
-    MT_DeviceLocal = 1,
-    MT_HostVisible = 2
-};
-
 ///////////////////////////////////////////////////////////////////////////////
-VkDeviceMemory AllocateMemory(const std::vector<MemoryTypeInfo>& memoryInfos,
-    VkDevice device, const int size, const uint32_t memoryBits,
-    unsigned int memoryProperties, bool* isHostCoherent = nullptr)
+void VulkanTexturedQuad::UploadsCompleteImpl()
 {
-    for (auto& memoryInfo : memoryInfos)
+    if (rubyImageView_.Get () == VK_NULL_HANDLE)
     {
-        if (((1 << memoryInfo.index) & memoryBits) == 0) {
-            continue;
-        }
-
-        if ((memoryProperties & MT_DeviceLocal) && !memoryInfo.deviceLocal)
-        {
-            continue;
-        }
-
-        if ((memoryProperties & MT_HostVisible) && !memoryInfo.hostVisible)
-        {
-            continue;
-        }
-
-        if (isHostCoherent)
-        {
-            *isHostCoherent = memoryInfo.hostCoherent;
-        }
-
-        VkMemoryAllocateInfo memoryAllocateInfo = {};
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.memoryTypeIndex = memoryInfo.index;
-        memoryAllocateInfo.allocationSize = size;
-
-        VkDeviceMemory deviceMemory;
-        vkAllocateMemory(device, &memoryAllocateInfo, nullptr,
-            &deviceMemory);
-        return deviceMemory;
+        // The texture never made it, keep showing the placeholder
+        return;
     }
 
-    return VK_NULL_HANDLE;
+    UpdateDescriptorSet (rubyImageView_.Get ());
+
+    // Frames in flight may still sample it, the deletion queue takes care
+    placeholderImageView_.Reset ();
+    placeholderImage_.Reset ();
+    placeholderImageMemory_.Reset ();
 }
 
+namespace
+{
 ///////////////////////////////////////////////////////////////////////////////
-VkBuffer AllocateBuffer(VkDevice device, const int size,
+VkBufferCreateInfo GetBufferCreateInfo(const int size,
     const VkBufferUsageFlags bits)
 {
     VkBufferCreateInfo bufferCreateInfo = {};
@@ -220,19 +132,45 @@ VkBuffer AllocateBuffer(VkDevice device, const int size,
     bufferCreateInfo.size = static_cast<uint32_t> (size);
     bufferCreateInfo.usage = bits;
 
+    return bufferCreateInfo;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+VkBuffer AllocateBuffer(VkDevice device, const VkBufferCreateInfo& bufferCreateInfo,
+    const VkAllocationCallbacks* allocationCallbacks)
+{
     VkBuffer result;
-    vkCreateBuffer(device, &bufferCreateInfo, nullptr, &result);
+    vkCreateBuffer(device, &bufferCreateInfo, allocationCallbacks, &result);
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+VkImageView CreateImageView(VkDevice device, VkImage image, VkFormat format,
+    const VkAllocationCallbacks* allocationCallbacks)
+{
+    VkImageViewCreateInfo imageViewCreateInfo = {};
+    imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageViewCreateInfo.format = format;
+    imageViewCreateInfo.image = image;
+    imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imageViewCreateInfo.subresourceRange.levelCount = 1;
+    imageViewCreateInfo.subresourceRange.layerCount = 1;
+    imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+
+    VkImageView result;
+    vkCreateImageView(device, &imageViewCreateInfo, allocationCallbacks, &result);
     return result;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-VkPipelineLayout CreatePipelineLayout(VkDevice device)
+VkPipelineLayout CreatePipelineLayout(VkDevice device,
+    const VkAllocationCallbacks* allocationCallbacks)
 {
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
     pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 
     VkPipelineLayout result;
-    vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr,
+    vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, allocationCallbacks,
         &result);
 
     return result;
@@ -240,7 +178,7 @@ VkPipelineLayout CreatePipelineLayout(VkDevice device)
 
 ///////////////////////////////////////////////////////////////////////////////
 VkShaderModule LoadShader(VkDevice device, const void* shaderContents,
-    const size_t size)
+    const size_t size, const VkAllocationCallbacks* allocationCallbacks)
 {
     VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
     shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -249,14 +187,15 @@ VkShaderModule LoadShader(VkDevice device, const void* shaderContents,
     shaderModuleCreateInfo.codeSize = size;
 
     VkShaderModule result;
-    vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &result);
+    vkCreateShaderModule(device, &shaderModuleCreateInfo, allocationCallbacks, &result);
 
     return result;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 VkPipeline CreatePipeline(VkDevice device, VkRenderPass renderPass, VkPipelineLayout layout,
-    VkShaderModule vertexShader, VkShaderModule fragmentShader)
+    VkShaderModule vertexShader, VkShaderModule fragmentShader,
+    const VkAllocationCallbacks* allocationCallbacks)
 {
     VkVertexInputBindingDescription vertexInputBindingDescription;
     vertexInputBindingDescription.binding = 0;
@@ -365,14 +304,14 @@ VkPipeline CreatePipeline(VkDevice device, VkRenderPass renderPass, VkPipelineLa
 
     VkPipeline pipeline;
     vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &graphicsPipelineCreateInfo,
-        nullptr, &pipeline);
+        allocationCallbacks, &pipeline);
 
     return pipeline;
 }
 }   // namespace
 
 ///////////////////////////////////////////////////////////////////////////////
-void VulkanTexturedQuad::CreateMeshBuffers(VkCommandBuffer uploadCommandBuffer)
+bool VulkanTexturedQuad::CreateMeshBuffers(VkCommandBuffer uploadCommandBuffer)
 {
     struct Vertex
     {
@@ -397,114 +336,98 @@ void VulkanTexturedQuad::CreateMeshBuffers(VkCommandBuffer uploadCommandBuffer)
         0, 1, 2, 2, 3, 0
     };
 
-    auto memoryHeaps = EnumerateHeaps(physicalDevice_);
+    auto& deletionQueue = GetDeletionQueue();
 
-    indexBuffer_ = AllocateBuffer(device_, sizeof(indices),
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-    vertexBuffer_ = AllocateBuffer(device_, sizeof(vertices),
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    const VkAllocationCallbacks* allocationCallbacks = GetAllocationCallbacks();
+
+    // TRANSFER_SRC so the defragmenter can move them
+    const VkBufferCreateInfo indexBufferCreateInfo = GetBufferCreateInfo(sizeof(indices),
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    const VkBufferCreateInfo vertexBufferCreateInfo = GetBufferCreateInfo(sizeof(vertices),
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+
+    indexBuffer_ = UniqueBuffer(AllocateBuffer(device_, indexBufferCreateInfo,
+        allocationCallbacks), deletionQueue);
+    vertexBuffer_ = UniqueBuffer(AllocateBuffer(device_, vertexBufferCreateInfo,
+        allocationCallbacks), deletionQueue);
 
     VkMemoryRequirements vertexBufferMemoryRequirements = {};
-    vkGetBufferMemoryRequirements(device_, vertexBuffer_,
+    vkGetBufferMemoryRequirements(device_, vertexBuffer_.Get(),
         &vertexBufferMemoryRequirements);
     VkMemoryRequirements indexBufferMemoryRequirements = {};
-    vkGetBufferMemoryRequirements(device_, indexBuffer_,
+    vkGetBufferMemoryRequirements(device_, indexBuffer_.Get(),
         &indexBufferMemoryRequirements);
 
-    VkDeviceSize bufferSize = vertexBufferMemoryRequirements.size;
-    // We want to place the index buffer behind the vertex buffer. Need to take
-    // the alignment into account to find the next suitable location
-    VkDeviceSize indexBufferOffset = RoundToNextMultiple(bufferSize,
-        indexBufferMemoryRequirements.alignment);
-
-    bufferSize = indexBufferOffset + indexBufferMemoryRequirements.size;
-    deviceBufferMemory_ = AllocateMemory(memoryHeaps, device_,
-        static_cast<int>(bufferSize),
-        vertexBufferMemoryRequirements.memoryTypeBits & indexBufferMemoryRequirements.memoryTypeBits,
-        MT_DeviceLocal);
-
-    vkBindBufferMemory(device_, vertexBuffer_, deviceBufferMemory_, 0);
-    vkBindBufferMemory(device_, indexBuffer_, deviceBufferMemory_,
-        indexBufferOffset);
-
-    uploadBufferBuffer_ = AllocateBuffer (device_, static_cast<int> (bufferSize),
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    VkMemoryRequirements uploadBufferMemoryRequirements = {};
-    vkGetBufferMemoryRequirements (device_, uploadBufferBuffer_,
-        &uploadBufferMemoryRequirements);
-
-    bool memoryIsHostCoherent = false;
-    uploadBufferMemory_ = AllocateMemory(memoryHeaps, device_,
-        static_cast<int>(uploadBufferMemoryRequirements.size),
-        vertexBufferMemoryRequirements.memoryTypeBits & indexBufferMemoryRequirements.memoryTypeBits,
-        MT_HostVisible, &memoryIsHostCoherent);
-
-    vkBindBufferMemory (device_, uploadBufferBuffer_, uploadBufferMemory_, 0);
-
-    void* mapping = nullptr;
-    vkMapMemory(device_, uploadBufferMemory_, 0, VK_WHOLE_SIZE,
-        0, &mapping);
-    ::memcpy(mapping, vertices, sizeof(vertices));
-
-    ::memcpy(static_cast<uint8_t*> (mapping) + indexBufferOffset,
-        indices, sizeof(indices));
-
-    if (!memoryIsHostCoherent) 
+    // With resizable BAR, the data is written in place instead of staged
+    auto& allocator = GetDeviceMemoryAllocator();
+
+    DeviceMemoryAllocation vertexBufferMemory;
+    DeviceMemoryAllocation indexBufferMemory;
+    if (!allocator.Allocate(vertexBufferMemoryRequirements,
+            GetUploadMemoryUsage(vertexBufferMemoryRequirements), DMRT_Linear,
+            &vertexBufferMemory) ||
+        !allocator.Allocate(indexBufferMemoryRequirements,
+            GetUploadMemoryUsage(indexBufferMemoryRequirements), DMRT_Linear,
+            &indexBufferMemory))
     {
-        VkMappedMemoryRange mappedMemoryRange = {};
-        mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedMemoryRange.memory = uploadBufferMemory_;
-        mappedMemoryRange.offset = 0;
-        mappedMemoryRange.size = VK_WHOLE_SIZE;
+        // Nothing uses them yet
+        allocator.Free(vertexBufferMemory);
+        vertexBuffer_.Reset();
+        indexBuffer_.Reset();
+        return false;
+    }
+
+    vertexBufferMemory_ = UniqueAllocation(vertexBufferMemory, deletionQueue);
+    indexBufferMemory_ = UniqueAllocation(indexBufferMemory, deletionQueue);
 
-        vkFlushMappedMemoryRanges (device_, 1, &mappedMemoryRange);
+    vkBindBufferMemory(device_, vertexBuffer_.Get(), vertexBufferMemory_->memory,
+        vertexBufferMemory_->offset);
+    vkBindBufferMemory(device_, indexBuffer_.Get(), indexBufferMemory_->memory,
+        indexBufferMemory_->offset);
+
+    // Recorded on the graphics queue, so no ownership transfer is needed.
+    // Both buffers end up behind one barrier, if they are staged at all.
+    UploadBatcher uploadBatcher(allocator, GetStagingRing());
+
+    bool staged = uploadBatcher.AddBufferUpload(vertexBuffer_.Get(),
+        vertexBufferMemory_.Get(), 0, vertices, sizeof(vertices),
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+    staged = uploadBatcher.AddBufferUpload(indexBuffer_.Get(),
+        indexBufferMemory_.Get(), 0, indices, sizeof(indices),
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT) && staged;
+
+    if (!staged)
+    {
+        return false;
     }
 
-    vkUnmapMemory(device_, uploadBufferMemory_);
-
-    VkBufferCopy vertexCopy = {};
-    vertexCopy.size = sizeof (vertices);
-
-    VkBufferCopy indexCopy = {};
-    indexCopy.size = sizeof (indices);
-    indexCopy.srcOffset = indexBufferOffset;
-
-    vkCmdCopyBuffer (uploadCommandBuffer, uploadBufferBuffer_, vertexBuffer_,
-        1, &vertexCopy);
-    vkCmdCopyBuffer (uploadCommandBuffer, uploadBufferBuffer_, indexBuffer_,
-        1, &indexCopy);
-
-    VkBufferMemoryBarrier uploadBarriers[2] = {};
-    uploadBarriers[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-    uploadBarriers[0].buffer = vertexBuffer_;
-    uploadBarriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    uploadBarriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    uploadBarriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    uploadBarriers[0].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
-    uploadBarriers[0].size = VK_WHOLE_SIZE;
-
-    uploadBarriers[1].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-    uploadBarriers[1].buffer = indexBuffer_;
-    uploadBarriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    uploadBarriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    uploadBarriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    uploadBarriers[1].dstAccessMask = VK_ACCESS_INDEX_READ_BIT;
-    uploadBarriers[1].size = VK_WHOLE_SIZE;
-
-    vkCmdPipelineBarrier (uploadCommandBuffer,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-        0, 0, nullptr, 2, uploadBarriers,
-        0, nullptr);
+    uploadBatcher.Record(uploadCommandBuffer);
+
+    auto& defragmenter = GetDefragmenter();
+
+    defragmenter.RegisterBuffer(vertexBuffer_.Get(), vertexBufferCreateInfo,
+        vertexBufferMemory_.Get(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        [this](VkBuffer buffer, const DeviceMemoryAllocation& allocation) {
+        vertexBuffer_ = UniqueBuffer(buffer, GetDeletionQueue());
+        vertexBufferMemory_ = UniqueAllocation(allocation, GetDeletionQueue());
+    });
+    defragmenter.RegisterBuffer(indexBuffer_.Get(), indexBufferCreateInfo,
+        indexBufferMemory_.Get(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        VK_ACCESS_INDEX_READ_BIT,
+        [this](VkBuffer buffer, const DeviceMemoryAllocation& allocation) {
+        indexBuffer_ = UniqueBuffer(buffer, GetDeletionQueue());
+        indexBufferMemory_ = UniqueAllocation(allocation, GetDeletionQueue());
+    });
+
+    return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-void VulkanTexturedQuad::CreateTexture (VkCommandBuffer uploadCommandList)
+void VulkanTexturedQuad::CreateTexture ()
 {
-    int width, height;
-    auto image = LoadImageFromMemory (RubyTexture, sizeof (RubyTexture),
-        1, &width, &height);
-
     VkImageCreateInfo imageCreateInfo = {};
     imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageCreateInfo.pNext = nullptr;
@@ -515,119 +438,192 @@ void VulkanTexturedQuad::CreateTexture (VkCommandBuffer uploadCommandList)
     imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
     imageCreateInfo.arrayLayers = 1;
     imageCreateInfo.extent.depth = 1;
-    imageCreateInfo.extent.height = height;
-    imageCreateInfo.extent.width = width;
-    imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
     imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-    vkCreateImage (device_, &imageCreateInfo, nullptr, &rubyImage_);
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    vkGetPhysicalDeviceProperties (physicalDevice_, &physicalDeviceProperties);
+
+    // Rows padded the way the device copies fastest, and at least to whole
+    // texels
+    const std::size_t rowPitchAlignment = std::max<std::size_t> (4,
+        static_cast<std::size_t> (
+            physicalDeviceProperties.limits.optimalBufferCopyRowPitchAlignment));
+
+    auto& deletionQueue = GetDeletionQueue ();
+
+    VkImageSubresourceLayers subresource = {};
+    subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresource.layerCount = 1;
+
+    VkImage rubyImage = VK_NULL_HANDLE;
+    DeviceMemoryAllocation deviceImageMemory;
+    // Set once a copy into the image has been batched
+    bool uploadBatched = false;
+
+    // The image is created once the decoder knows its size, and decoded
+    // straight into the staging ring. The upload is batched with the
+    // others of InitializeImpl(), the base class hands the image over to
+    // the graphics queue.
+    const bool staged = DecodeImageFromMemory (RubyTexture, sizeof (RubyTexture),
+        [&](const int imageWidth, const int imageHeight, std::size_t* rowPitch) -> void* {
+        imageCreateInfo.extent.width = static_cast<uint32_t> (imageWidth);
+        imageCreateInfo.extent.height = static_cast<uint32_t> (imageHeight);
+
+        vkCreateImage (device_, &imageCreateInfo, GetAllocationCallbacks (), &rubyImage);
+        rubyImage_ = UniqueImage (rubyImage, deletionQueue);
+
+        // Gets its own memory object if the driver prefers that for the image
+        if (!GetDeviceMemoryAllocator ().AllocateForImage (rubyImage, MU_GpuOnly,
+            &deviceImageMemory))
+        {
+            rubyImage_.Reset ();
+            rubyImage = VK_NULL_HANDLE;
+            return nullptr;
+        }
 
-    VkMemoryRequirements requirements = {};
-    vkGetImageMemoryRequirements (device_, rubyImage_,
-        &requirements);
+        deviceImageMemory_ = UniqueAllocation (deviceImageMemory, deletionQueue);
 
-    VkDeviceSize requiredSizeForImage = requirements.size;
+        vkBindImageMemory (device_, rubyImage, deviceImageMemory.memory,
+            deviceImageMemory.offset);
 
-    auto memoryHeaps = EnumerateHeaps (physicalDevice_);
-    deviceImageMemory_ = AllocateMemory (memoryHeaps, device_, static_cast<int> (requiredSizeForImage),
-        requirements.memoryTypeBits,
-        MT_DeviceLocal);
+        *rowPitch = RoundToNextMultiple (static_cast<std::size_t> (imageWidth) * 4,
+            rowPitchAlignment);
 
-    vkBindImageMemory (device_, rubyImage_, deviceImageMemory_, 0);
+        void* destination = GetUploadBatcher ().AllocateImageUpload (rubyImage, subresource,
+            imageCreateInfo.extent, static_cast<uint32_t> (*rowPitch / 4),
+            *rowPitch * imageHeight, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        uploadBatched = destination != nullptr;
 
-    VkBufferCreateInfo bufferCreateInfo = {};
-    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferCreateInfo.pNext = nullptr;
-    bufferCreateInfo.queueFamilyIndexCount = 1;
-    bufferCreateInfo.pQueueFamilyIndices = &queueFamilyIndex;
-    bufferCreateInfo.size = requiredSizeForImage;
-    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        return destination;
+    }, nullptr, nullptr);
 
-    vkCreateBuffer (device_, &bufferCreateInfo, nullptr, &uploadImageBuffer_);
+    if (!staged)
+    {
+        // Nothing refers to the image unless a copy into it was batched
+        // before decoding failed. Only then it has to stay around until the
+        // batch is done. Either way InitializeImpl() keeps the placeholder
+        // bound instead.
+        if (!uploadBatched)
+        {
+            deviceImageMemory_.Reset ();
+            rubyImage_.Reset ();
+        }
 
-    vkGetBufferMemoryRequirements (device_, uploadImageBuffer_, &requirements);
+        DebugPrint ("Could not upload the texture, using a placeholder\n");
+        return;
+    }
 
-    VkDeviceSize requiredSizeForBuffer = requirements.size;
+    rubyImageView_ = UniqueImageView (CreateImageView (device_, rubyImage,
+        imageCreateInfo.format, GetAllocationCallbacks ()), deletionQueue);
+
+    // A move needs a new view and descriptor set as well. The view goes
+    // first, so the old one is destroyed before the old image.
+    const VkFormat format = imageCreateInfo.format;
+
+    GetDefragmenter ().RegisterImage (rubyImage, imageCreateInfo,
+        deviceImageMemory, VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+        [this, format](VkImage image, const DeviceMemoryAllocation& allocation) {
+        auto& deletionQueue = GetDeletionQueue ();
+        rubyImageView_ = UniqueImageView (CreateImageView (device_, image,
+            format, GetAllocationCallbacks ()), deletionQueue);
+        rubyImage_ = UniqueImage (image, deletionQueue);
+        deviceImageMemory_ = UniqueAllocation (allocation, deletionQueue);
+        UpdateDescriptorSet (rubyImageView_.Get ());
+    });
+}
 
-    bool memoryIsHostCoherent = false;
-    uploadImageMemory_ = AllocateMemory (memoryHeaps, device_,
-        static_cast<int> (requiredSizeForBuffer), requirements.memoryTypeBits,
-        MT_HostVisible, &memoryIsHostCoherent);
+///////////////////////////////////////////////////////////////////////////////
+bool VulkanTexturedQuad::CreatePlaceholderTexture (VkCommandBuffer setupCommandList)
+{
+    VkImageCreateInfo imageCreateInfo = {};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.extent.width = 1;
+    imageCreateInfo.extent.height = 1;
+    imageCreateInfo.extent.depth = 1;
+    imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-    vkBindBufferMemory (device_, uploadImageBuffer_, uploadImageMemory_, 0);
+    auto& deletionQueue = GetDeletionQueue ();
 
-    void* data = nullptr;
-    vkMapMemory (device_, uploadImageMemory_, 0, VK_WHOLE_SIZE,
-        0, &data);
-    ::memcpy (data, image.data (), image.size ());
-    
-    if (!memoryIsHostCoherent) 
-    {
-        VkMappedMemoryRange mappedMemoryRange = {};
-        mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedMemoryRange.memory = uploadImageMemory_;
-        mappedMemoryRange.offset = 0;
-        mappedMemoryRange.size = VK_WHOLE_SIZE;
+    VkImage placeholderImage = VK_NULL_HANDLE;
+    vkCreateImage (device_, &imageCreateInfo, GetAllocationCallbacks (),
+        &placeholderImage);
+    placeholderImage_ = UniqueImage (placeholderImage, deletionQueue);
 
-        vkFlushMappedMemoryRanges (device_, 1, &mappedMemoryRange);
+    DeviceMemoryAllocation placeholderImageMemory;
+    if (!GetDeviceMemoryAllocator ().AllocateForImage (placeholderImage, MU_GpuOnly,
+        &placeholderImageMemory))
+    {
+        placeholderImage_.Reset ();
+        return false;
     }
 
-    vkUnmapMemory (device_, uploadImageMemory_);
+    placeholderImageMemory_ = UniqueAllocation (placeholderImageMemory, deletionQueue);
 
-    VkBufferImageCopy bufferImageCopy = {};
-    bufferImageCopy.imageExtent.width = width;
-    bufferImageCopy.imageExtent.height = height;
-    bufferImageCopy.imageExtent.depth = 1;
-    bufferImageCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    bufferImageCopy.imageSubresource.mipLevel = 0;
-    bufferImageCopy.imageSubresource.layerCount = 1;
+    vkBindImageMemory (device_, placeholderImage, placeholderImageMemory.memory,
+        placeholderImageMemory.offset);
 
+    // A clear needs no staging, so the placeholder is ready with the setup
+    // command buffer
     VkImageMemoryBarrier imageBarrier = {};
     imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    imageBarrier.pNext = nullptr;
     imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     imageBarrier.srcAccessMask = 0;
     imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    imageBarrier.image = rubyImage_;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = placeholderImage;
     imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     imageBarrier.subresourceRange.layerCount = 1;
     imageBarrier.subresourceRange.levelCount = 1;
 
-    vkCmdPipelineBarrier (uploadCommandList,
+    vkCmdPipelineBarrier (setupCommandList,
         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
         VK_PIPELINE_STAGE_TRANSFER_BIT,
         0, 0, nullptr, 0, nullptr,
         1, &imageBarrier);
 
-    vkCmdCopyBufferToImage (uploadCommandList, uploadImageBuffer_,
-        rubyImage_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        1, &bufferImageCopy);
+    VkClearColorValue clearColor = {};
+    clearColor.float32 [0] = 0.5f;
+    clearColor.float32 [1] = 0.5f;
+    clearColor.float32 [2] = 0.5f;
+    clearColor.float32 [3] = 1.0f;
+
+    vkCmdClearColorImage (setupCommandList, placeholderImage,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor,
+        1, &imageBarrier.subresourceRange);
 
     imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
     imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
     imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-    vkCmdPipelineBarrier (uploadCommandList,
+    vkCmdPipelineBarrier (setupCommandList,
         VK_PIPELINE_STAGE_TRANSFER_BIT,
         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
         0, 0, nullptr, 0, nullptr,
         1, &imageBarrier);
 
-    VkImageViewCreateInfo imageViewCreateInfo = {};
-    imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    imageViewCreateInfo.format = imageCreateInfo.format;
-    imageViewCreateInfo.image = rubyImage_;
-    imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    imageViewCreateInfo.subresourceRange.levelCount = 1;
-    imageViewCreateInfo.subresourceRange.layerCount = 1;
-    imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    placeholderImageView_ = UniqueImageView (CreateImageView (device_,
+        placeholderImage, imageCreateInfo.format, GetAllocationCallbacks ()),
+        deletionQueue);
 
-    vkCreateImageView (device_, &imageViewCreateInfo, nullptr, &rubyImageView_);
+    return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -638,7 +634,9 @@ void VulkanTexturedQuad::CreateSampler ()
     samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
     samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
 
-    vkCreateSampler (device_, &samplerCreateInfo, nullptr, &sampler_);
+    VkSampler sampler = VK_NULL_HANDLE;
+    vkCreateSampler (device_, &samplerCreateInfo, GetAllocationCallbacks (), &sampler);
+    sampler_ = UniqueSampler (sampler, GetDeletionQueue ());
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -653,48 +651,96 @@ void VulkanTexturedQuad::CreateDescriptors ()
     descriptorSetLayoutBinding[1].descriptorCount = 1;
     descriptorSetLayoutBinding[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
     descriptorSetLayoutBinding[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    descriptorSetLayoutBinding[1].pImmutableSamplers = &sampler_;
+    descriptorSetLayoutBinding[1].pImmutableSamplers = sampler_.GetAddress ();
 
     VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo[1] = {};
     descriptorSetLayoutCreateInfo[0].sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     descriptorSetLayoutCreateInfo[0].bindingCount = 2;
     descriptorSetLayoutCreateInfo[0].pBindings = descriptorSetLayoutBinding;
 
+    auto& deletionQueue = GetDeletionQueue ();
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
     vkCreateDescriptorSetLayout (
         device_, descriptorSetLayoutCreateInfo,
-        nullptr, &descriptorSetLayout_);
+        GetAllocationCallbacks (), &descriptorSetLayout);
+    descriptorSetLayout_ = UniqueDescriptorSetLayout (descriptorSetLayout,
+        deletionQueue);
 
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
     pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout_;
+    pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
     pipelineLayoutCreateInfo.setLayoutCount = 1;
 
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
     vkCreatePipelineLayout (device_, &pipelineLayoutCreateInfo,
-        nullptr, &pipelineLayout_);
+        GetAllocationCallbacks (), &pipelineLayout);
+    pipelineLayout_ = UniquePipelineLayout (pipelineLayout, deletionQueue);
 
     VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
     descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    descriptorPoolCreateInfo.maxSets = 1;
+    // Room for replacement sets while the old ones are still in use by
+    // frames in flight, see UpdateDescriptorSet() - one per frame in
+    // flight on top of the current set. The placeholder set can still be
+    // alive when a defragmentation move replaces the first real one.
+    const uint32_t maxSets = static_cast<uint32_t> (GetQueueSlotCount ()) + 2;
+
+    descriptorPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    descriptorPoolCreateInfo.maxSets = maxSets;
 
     VkDescriptorPoolSize descriptorPoolSize [2] = {};
-    descriptorPoolSize[0].descriptorCount = 1;
+    descriptorPoolSize[0].descriptorCount = maxSets;
     descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    descriptorPoolSize[1].descriptorCount = 1;
+    descriptorPoolSize[1].descriptorCount = maxSets;
     descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
 
     descriptorPoolCreateInfo.poolSizeCount = 2;
     descriptorPoolCreateInfo.pPoolSizes = descriptorPoolSize;
 
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
     vkCreateDescriptorPool (device_, &descriptorPoolCreateInfo,
-        nullptr, &descriptorPool_);
+        GetAllocationCallbacks (), &descriptorPool);
+    descriptorPool_ = UniqueDescriptorPool (descriptorPool, deletionQueue);
+
+    // Until the texture upload has arrived, see UploadsCompleteImpl()
+    UpdateDescriptorSet (AreUploadsComplete () && rubyImageView_.Get () != VK_NULL_HANDLE
+        ? rubyImageView_.Get () : placeholderImageView_.Get ());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void VulkanTexturedQuad::UpdateDescriptorSet (VkImageView imageView)
+{
+    // Sets can't be updated while a frame in flight uses them, so a new
+    // set is written and the old one freed once those frames retire
+    if (descriptorSet_ != VK_NULL_HANDLE)
+    {
+        const VkDevice device = device_;
+        const VkDescriptorPool descriptorPool = descriptorPool_.Get ();
+        const VkDescriptorSet descriptorSet = descriptorSet_;
+
+        GetDeletionQueue ().Enqueue ([device, descriptorPool, descriptorSet]() {
+            vkFreeDescriptorSets (device, descriptorPool, 1, &descriptorSet);
+        });
+    }
 
     VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {};
     descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayout_;
+    descriptorSetAllocateInfo.pSetLayouts = descriptorSetLayout_.GetAddress ();
     descriptorSetAllocateInfo.descriptorSetCount = 1;
-    descriptorSetAllocateInfo.descriptorPool = descriptorPool_;
+    descriptorSetAllocateInfo.descriptorPool = descriptorPool_.Get ();
 
-    vkAllocateDescriptorSets (device_, &descriptorSetAllocateInfo, &descriptorSet_);
+    const VkResult result = vkAllocateDescriptorSets (device_,
+        &descriptorSetAllocateInfo, &descriptorSet_);
+
+    if (result != VK_SUCCESS)
+    {
+        // The old set is on its way out, so the quad is skipped until the
+        // next update succeeds rather than drawn with a stale view
+        DebugPrint ("vkAllocateDescriptorSets failed (%d)\n",
+            static_cast<int> (result));
+        descriptorSet_ = VK_NULL_HANDLE;
+        return;
+    }
 
     VkWriteDescriptorSet writeDescriptorSets[1] = {};
     writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -705,7 +751,7 @@ void VulkanTexturedQuad::CreateDescriptors ()
 
     VkDescriptorImageInfo descriptorImageInfo[1] = {};
     descriptorImageInfo[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    descriptorImageInfo[0].imageView = rubyImageView_;
+    descriptorImageInfo[0].imageView = imageView;
 
     writeDescriptorSets[0].pImageInfo = &descriptorImageInfo[0];
 
@@ -715,10 +761,16 @@ void VulkanTexturedQuad::CreateDescriptors ()
 ///////////////////////////////////////////////////////////////////////////////
 void VulkanTexturedQuad::CreatePipelineStateObject()
 {
-    vertexShader_ = LoadShader(device_, BasicVertexShader, sizeof(BasicVertexShader));
-    fragmentShader_ = LoadShader(device_, TexturedFragmentShader, sizeof(TexturedFragmentShader));
+    auto& deletionQueue = GetDeletionQueue();
+    const VkAllocationCallbacks* allocationCallbacks = GetAllocationCallbacks();
+
+    vertexShader_ = UniqueShaderModule(LoadShader(device_, BasicVertexShader,
+        sizeof(BasicVertexShader), allocationCallbacks), deletionQueue);
+    fragmentShader_ = UniqueShaderModule(LoadShader(device_, TexturedFragmentShader,
+        sizeof(TexturedFragmentShader), allocationCallbacks), deletionQueue);
 
-    pipeline_ = CreatePipeline(device_, renderPass_, pipelineLayout_,
-        vertexShader_, fragmentShader_);
+    pipeline_ = UniquePipeline(CreatePipeline(device_, renderPass_,
+        pipelineLayout_.Get(), vertexShader_.Get(), fragmentShader_.Get(),
+        allocationCallbacks), deletionQueue);
 }
 }   // namespace AMD
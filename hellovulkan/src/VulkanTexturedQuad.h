@@ -24,46 +24,56 @@
 #define AMD_VULKAN_SAMPLE_TEXTURED_QUAD_H_
 
 #include "VulkanSample.h"
+#include "UniqueHandle.h"
 
 namespace AMD
 {
 class VulkanTexturedQuad : public VulkanSample
 {
+public:
+    explicit VulkanTexturedQuad(const SampleOptions& options = SampleOptions());
+
 private:
     void CreatePipelineStateObject();
-    void CreateMeshBuffers(VkCommandBuffer uploadCommandList);
-    void CreateTexture(VkCommandBuffer uploadCommandList);
+    bool CreateMeshBuffers(VkCommandBuffer uploadCommandList);
+    void CreateTexture();
+    bool CreatePlaceholderTexture(VkCommandBuffer setupCommandList);
     void CreateDescriptors ();
+    void UpdateDescriptorSet (VkImageView imageView);
     void CreateSampler ();
     void RenderImpl(VkCommandBuffer commandList) override;
-    void InitializeImpl(VkCommandBuffer uploadCommandList) override;
-    void ShutdownImpl() override;
-
-    VkDeviceMemory deviceBufferMemory_ = VK_NULL_HANDLE;
-    VkBuffer vertexBuffer_ = VK_NULL_HANDLE;
-    VkBuffer indexBuffer_ = VK_NULL_HANDLE;
+    bool InitializeImpl(VkCommandBuffer uploadCommandList) override;
+    void UploadsCompleteImpl() override;
 
-    VkDeviceMemory uploadBufferMemory_ = VK_NULL_HANDLE;
-    VkBuffer uploadBufferBuffer_ = VK_NULL_HANDLE;
+    // Members are destroyed in reverse order, so memory goes after the
+    // objects bound to it, and the sampler after the set layout which
+    // uses it as an immutable sampler
+    UniqueSampler sampler_;
 
-    VkShaderModule vertexShader_ = VK_NULL_HANDLE;
-    VkShaderModule fragmentShader_ = VK_NULL_HANDLE;
+    UniqueAllocation vertexBufferMemory_;
+    UniqueAllocation indexBufferMemory_;
+    UniqueBuffer vertexBuffer_;
+    UniqueBuffer indexBuffer_;
 
-    VkPipeline pipeline_ = VK_NULL_HANDLE;
-    VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+    UniqueShaderModule vertexShader_;
+    UniqueShaderModule fragmentShader_;
 
-    VkDeviceMemory deviceImageMemory_ = VK_NULL_HANDLE;
-    VkImage rubyImage_ = VK_NULL_HANDLE;
-    VkImageView rubyImageView_ = VK_NULL_HANDLE;
+    UniqueAllocation deviceImageMemory_;
+    UniqueImage rubyImage_;
+    UniqueImageView rubyImageView_;
 
-    VkDeviceMemory uploadImageMemory_ = VK_NULL_HANDLE;
-    VkBuffer uploadImageBuffer_ = VK_NULL_HANDLE;
+    // Sampled until the texture upload has arrived
+    UniqueAllocation placeholderImageMemory_;
+    UniqueImage placeholderImage_;
+    UniqueImageView placeholderImageView_;
 
-    VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+    UniqueDescriptorSetLayout descriptorSetLayout_;
+    UniqueDescriptorPool descriptorPool_;
+    // Freed with the pool, or through the deletion queue when replaced
     VkDescriptorSet descriptorSet_ = VK_NULL_HANDLE;
-    VkDescriptorSetLayout descriptorSetLayout_ = VK_NULL_HANDLE;
 
-    VkSampler sampler_ = VK_NULL_HANDLE;
+    UniquePipelineLayout pipelineLayout_;
+    UniquePipeline pipeline_;
 };
 }
 
@@ -24,6 +24,7 @@
 
 namespace AMD
 {
+#ifdef _WIN32
 namespace
 {
 ///////////////////////////////////////////////////////////////////////////////
@@ -42,11 +43,20 @@ LRESULT CALLBACK amdWndProc(
     case WM_CLOSE:
         window->OnClose();
         return 0;
+
+    case WM_SIZE:
+        // Sent during CreateWindow, before the user data is set
+        if (window)
+        {
+            window->OnResize(LOWORD(lParam), HIWORD(lParam));
+        }
+        return 0;
     }
 
     return ::DefWindowProcA(hwnd, uMsg, wParam, lParam);
 }
 }   // namespace
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 IWindow::~IWindow()
@@ -65,12 +75,25 @@ int IWindow::GetHeight() const
     return GetHeightImpl();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+bool IWindow::IsClosed() const
+{
+    return IsClosedImpl();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void IWindow::ProcessEvents()
+{
+    ProcessEventsImpl();
+}
+
+#ifdef _WIN32
 ///////////////////////////////////////////////////////////////////////////////
 Window::Window(const std::string& title, const int width, const int height)
     : width_ (width)
     , height_ (height)
 {
-    DWORD style = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX;
+    DWORD style = WS_OVERLAPPEDWINDOW;
 
     ::RECT rect;
     ::SetRect(&rect, 0, 0, width, height);
@@ -93,15 +116,20 @@ Window::Window(const std::string& title, const int width, const int height)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-bool IWindow::IsClosed() const
+HWND Window::GetHWND () const
 {
-    return IsClosedImpl();
+    return hwnd_;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-HWND Window::GetHWND () const
+void Window::ProcessEventsImpl()
 {
-    return hwnd_;
+    ::MSG msg;
+    while (::PeekMessageA(&msg, hwnd_, 0, 0, PM_REMOVE))
+    {
+        ::TranslateMessage(&msg);
+        ::DispatchMessageA(&msg);
+    }
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -137,5 +165,6 @@ WindowClass::~WindowClass()
     ::UnregisterClassA(name_.c_str(),
         (HINSTANCE)::GetModuleHandle(NULL));
 }
+#endif
 
 }   // namespace AMD
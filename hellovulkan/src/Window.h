@@ -24,11 +24,15 @@
 #define AMD_VULKAN_SAMPLE_WINDOW_H_
 
 #include <string>
-#include <Windows.h>
 #include <memory>
 
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
 namespace AMD
 {
+#ifdef _WIN32
 /**
 * Encapsulate a window class.
 *
@@ -50,6 +54,7 @@ public:
 private:
     std::string name_;
 };
+#endif
 
 struct IWindow
 {
@@ -63,15 +68,28 @@ public:
     bool IsClosed() const;
     virtual void OnClose() = 0;
 
+    /**
+    * Called with the new client area size. A minimized window has a size
+    * of 0x0.
+    */
+    virtual void OnResize(int width, int height) = 0;
+
     int GetWidth() const;
     int GetHeight() const;
 
+    /**
+    * Handle all pending window messages without blocking.
+    */
+    void ProcessEvents();
+
 private:
+    virtual void ProcessEventsImpl() {}
     virtual bool IsClosedImpl() const = 0;
     virtual int GetWidthImpl() const = 0;
     virtual int GetHeightImpl() const = 0;
 };
 
+#ifdef _WIN32
 class Window : public IWindow
 {
 public:
@@ -84,7 +102,15 @@ public:
         isClosed_ = true;
     }
 
+    void OnResize(int width, int height) override
+    {
+        width_ = width;
+        height_ = height;
+    }
+
 private:
+    void ProcessEventsImpl() override;
+
     bool IsClosedImpl() const override
     {
         return isClosed_;
@@ -105,6 +131,53 @@ private:
     bool isClosed_ = false;
     int width_ = -1, height_ = -1;
 };
+#endif
+
+/**
+* A window without any on-screen representation.
+*
+* Used when rendering offscreen, where only the size of the render targets
+* is needed. Works on any platform.
+*/
+class HeadlessWindow : public IWindow
+{
+public:
+    HeadlessWindow(int width, int height)
+        : width_ (width)
+        , height_ (height)
+    {
+    }
+
+    void OnClose() override
+    {
+        isClosed_ = true;
+    }
+
+    void OnResize(int width, int height) override
+    {
+        width_ = width;
+        height_ = height;
+    }
+
+private:
+    bool IsClosedImpl() const override
+    {
+        return isClosed_;
+    }
+
+    int GetWidthImpl() const override
+    {
+        return width_;
+    }
+
+    int GetHeightImpl() const override
+    {
+        return height_;
+    }
+
+    bool isClosed_ = false;
+    int width_ = -1, height_ = -1;
+};
 
 }   // namespace AMD
 
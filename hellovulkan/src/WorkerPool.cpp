@@ -0,0 +1,115 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "WorkerPool.h"
+
+#include <cassert>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+WorkerPool::WorkerPool(const int workerCount)
+{
+    assert(workerCount > 0);
+
+    for (int i = 0; i < workerCount; ++i)
+    {
+        workers_.emplace_back(&WorkerPool::WorkerMain, this, i);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        exit_ = true;
+    }
+
+    workAvailable_.notify_all();
+
+    for (auto& worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void WorkerPool::Execute(const int taskCount,
+    const std::function<void(int taskIndex, int workerIndex)>& function)
+{
+    if (taskCount <= 0)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    function_ = &function;
+    taskCount_ = taskCount;
+    nextTask_ = 0;
+    finishedTasks_ = 0;
+    ++generation_;
+
+    workAvailable_.notify_all();
+
+    workDone_.wait(lock, [this]() { return finishedTasks_ == taskCount_; });
+
+    function_ = nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void WorkerPool::WorkerMain(const int workerIndex)
+{
+    int lastGeneration = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    for (;;)
+    {
+        workAvailable_.wait(lock, [this, lastGeneration]() {
+            return exit_ || generation_ != lastGeneration;
+        });
+
+        if (exit_)
+        {
+            return;
+        }
+
+        lastGeneration = generation_;
+
+        while (nextTask_ < taskCount_)
+        {
+            const int taskIndex = nextTask_++;
+
+            lock.unlock();
+            (*function_)(taskIndex, workerIndex);
+            lock.lock();
+
+            if (++finishedTasks_ == taskCount_)
+            {
+                workDone_.notify_one();
+            }
+        }
+    }
+}
+}   // namespace AMD
@@ -0,0 +1,83 @@
+//
+// Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef AMD_VULKAN_SAMPLE_WORKERPOOL_H_
+#define AMD_VULKAN_SAMPLE_WORKERPOOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace AMD
+{
+///////////////////////////////////////////////////////////////////////////////
+/**
+* Fixed set of worker threads which execute a number of tasks in parallel.
+* Work is handed out one task at a time, so tasks of different cost are
+* balanced across the workers.
+*/
+class WorkerPool
+{
+public:
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator= (const WorkerPool&) = delete;
+
+    explicit WorkerPool(const int workerCount);
+    ~WorkerPool();
+
+    int GetWorkerCount() const
+    {
+        return static_cast<int> (workers_.size());
+    }
+
+    /**
+    * Call function(taskIndex, workerIndex) for every task in
+    * [0, taskCount) and block until all of them are done. A given
+    * workerIndex is only ever used by one thread at a time, so it can be
+    * used to index per-worker resources.
+    */
+    void Execute(const int taskCount,
+        const std::function<void(int taskIndex, int workerIndex)>& function);
+
+private:
+    void WorkerMain(const int workerIndex);
+
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable workAvailable_;
+    std::condition_variable workDone_;
+
+    const std::function<void(int, int)>* function_ = nullptr;
+    int taskCount_ = 0;
+    int nextTask_ = 0;
+    int finishedTasks_ = 0;
+    // Incremented for every Execute() call so workers can tell a new batch
+    // of work from a spurious wakeup
+    int generation_ = 0;
+    bool exit_ = false;
+};
+}   // namespace AMD
+
+#endif